@@ -3,4 +3,7 @@
 
 ClassicPrint *ClassicPrintDeclarative::classicPrint;
 QString ClassicPrintDeclarative::destinationFolder;
+QAtomicInt ClassicPrintDeclarative::previewSequence;
+ClassicPrintRecipe ClassicPrintDeclarative::previewRecipe;
+QMutex ClassicPrintDeclarative::previewRecipeLock;
 
@@ -11,6 +11,9 @@
 #include "ClassicPrintProcessing.h"
 
 #include "ClassicPrintThread.h"
+#include "TilePyramid.h"
+
+#include "scaled_decode.h"
 
 class ClassicPrintDeclarative : public QObject {
     Q_OBJECT
@@ -19,6 +22,7 @@ class ClassicPrintDeclarative : public QObject {
         ClassicPrintDeclarative(QObject *parent=NULL)
             : QObject(parent),
               m_sequence(0),
+              m_draft(false),
               m_timer(),
               m_progress(0),
               m_working(false),
@@ -29,7 +33,7 @@ class ClassicPrintDeclarative : public QObject {
             m_timer.setSingleShot(true);
 
             QObject::connect(&m_timer, SIGNAL(timeout()),
-                    this, SIGNAL(sequenceChanged()));
+                    this, SLOT(finishDraft()));
 
             /* Lens */
             QObject::connect(this, SIGNAL(radiusChanged()),
@@ -69,6 +73,8 @@ class ClassicPrintDeclarative : public QObject {
                     this, SLOT(onProgress(int)));
             QObject::connect(getClassicPrint(), SIGNAL(working(bool)),
                     this, SLOT(onWorking(bool)));
+
+            setPreviewRecipe(getClassicPrint()->recipe());
         }
 
         static void init() {
@@ -82,6 +88,13 @@ class ClassicPrintDeclarative : public QObject {
             return classicPrint;
         }
 
+        /* Settings to render previews with, taken when the sequence was
+         * last published. Safe to call from the image provider thread */
+        static ClassicPrintRecipe getPreviewRecipe() {
+            QMutexLocker locker(&previewRecipeLock);
+            return previewRecipe;
+        }
+
 
         Q_INVOKABLE
         void save(QString filename) {
@@ -97,7 +110,10 @@ class ClassicPrintDeclarative : public QObject {
             QString now = QDateTime::currentDateTime().toString("yyyy-MM-dd_hh-mm-ss");
             QString destination = fi.baseName() + "_" + now + "." + fi.suffix();
 
+            // The preview recipe has its "Random" light leak picked, so the
+            // photo is saved with the leak shown in the preview
             m_thread = new ClassicPrintThread(getClassicPrint(),
+                    getPreviewRecipe(),
                     filename, QDir(destinationFolder).filePath(destination));
 
             QObject::connect(m_thread, SIGNAL(finished()),
@@ -286,6 +302,12 @@ class ClassicPrintDeclarative : public QObject {
         int sequence() { return m_sequence; }
         Q_PROPERTY(int sequence READ sequence NOTIFY sequenceChanged)
 
+        /* True while the preview for the current sequence should be a
+         * quick low resolution draft. Settles to false once the settings
+         * have stopped changing for a while */
+        bool draft() { return m_draft; }
+        Q_PROPERTY(bool draft READ draft NOTIFY sequenceChanged)
+
         int progress() { return m_progress; }
         Q_PROPERTY(int progress READ progress NOTIFY progressChanged)
 
@@ -295,8 +317,32 @@ class ClassicPrintDeclarative : public QObject {
         bool saving() { return m_saving; }
         Q_PROPERTY(bool saving READ saving NOTIFY savingChanged)
 
+        /* Zoomed preview, made of the tiles of a TilePyramid */
+        int tileSize() { return TILEPYRAMID_TILE_SIZE; }
+        Q_PROPERTY(int tileSize READ tileSize CONSTANT)
+
+        Q_INVOKABLE
+        int tileLevels(QString filename) {
+            return TilePyramid::levelCount(originalSize(filename));
+        }
+
+        /* Size of the processed photo, frame included, at a level of the
+         * tiles. Changes with the frame size, so call it again when the
+         * sequence changes */
+        Q_INVOKABLE
+        QSize tiledSize(QString filename, int level) {
+            QSize size = TilePyramid::levelSize(originalSize(filename), level);
+            if (!size.isValid()) {
+                return QSize();
+            }
+            return getClassicPrint()->processedSize(getPreviewRecipe(), size);
+        }
+
         static QString destinationFolder;
 
+        /* Sequence of the preview QML currently wants */
+        static QAtomicInt previewSequence;
+
     signals:
         /* Lens */
         void radiusChanged();
@@ -322,10 +368,23 @@ class ClassicPrintDeclarative : public QObject {
     public slots:
         void contentUpdated() {
             m_sequence++;
-            // wait a bit to avoid too many updates
+
+            // Previews still rendering for an older sequence are abandoned
+            // now that QML is about to request a draft of this one
+            setPreviewRecipe(getClassicPrint()->recipe());
+            previewSequence = m_sequence;
+            m_draft = true;
+            emit sequenceChanged();
+
+            // wait a bit before the full render to avoid too many updates
             m_timer.start();
         }
 
+        void finishDraft() {
+            m_draft = false;
+            emit sequenceChanged();
+        }
+
         void onProgress(int progress) {
             if (progress != m_progress) {
                 m_progress = progress;
@@ -348,14 +407,33 @@ class ClassicPrintDeclarative : public QObject {
         }
 
     private:
+        static void setPreviewRecipe(const ClassicPrintRecipe &recipe) {
+            QMutexLocker locker(&previewRecipeLock);
+            previewRecipe = recipe;
+        }
+
+        /* Size of the photo shown, read again only for another photo */
+        QSize originalSize(const QString &filename) {
+            if (filename != m_sizeFilename) {
+                m_sizeFilename = filename;
+                m_originalSize = image_size(filename);
+            }
+            return m_originalSize;
+        }
+
         static ClassicPrint *classicPrint;
+        static ClassicPrintRecipe previewRecipe;
+        static QMutex previewRecipeLock;
 
         int m_sequence;
+        bool m_draft;
         QTimer m_timer;
         int m_progress;
         bool m_working;
         ClassicPrintThread *m_thread;
         bool m_saving;
+        QString m_sizeFilename;
+        QSize m_originalSize;
 };
 
 #endif
@@ -8,10 +8,25 @@
 #include "ClassicPrint.h"
 #include "ClassicPrintDeclarative.h"
 
+#include "scaled_decode.h"
+
+// Total size in kilobytes of the decoded and scaled photos kept around
+#define CLASSICPRINTPROVIDER_SOURCE_CACHE_KB (32 * 1024)
+
+// Drafts ('#<sequence>d' ids) are rendered at this fraction of the
+// requested width and height, then scaled up for display
+#define CLASSICPRINTPROVIDER_DRAFT_DIVISOR 4
+
+// Ids are '<file>#<sequence>', followed by 'd' for a draft and then
+// optionally '@<x>,<y>,<width>,<height>' to render only that part of the
+// processed photo, frame included, at the requested size. The part has the
+// same pixels as the whole render has there, so a zoomed in view only
+// renders what is visible
 class ClassicPrintProvider : public QDeclarativeImageProvider {
     public:
         ClassicPrintProvider()
-            : QDeclarativeImageProvider(QDeclarativeImageProvider::Image)
+            : QDeclarativeImageProvider(QDeclarativeImageProvider::Image),
+              m_sources(CLASSICPRINTPROVIDER_SOURCE_CACHE_KB)
         {
         }
 
@@ -23,33 +38,96 @@ class ClassicPrintProvider : public QDeclarativeImageProvider {
             }
 
             QString filename(id);
+            CancelToken cancel;
+            bool draft = false;
+            QRect region;
             int pos = -1;
             if ((pos = id.lastIndexOf("#")) != -1) {
                 filename = filename.mid(0, pos);
+
+                QString sequenceText = id.mid(pos + 1);
+                int at = sequenceText.indexOf("@");
+                if (at != -1) {
+                    region = parseRegion(sequenceText.mid(at + 1));
+                    sequenceText.truncate(at);
+                }
+                if (sequenceText.endsWith("d")) {
+                    draft = true;
+                    sequenceText.chop(1);
+                }
+
+                // Give up on this preview once a newer one has been asked for
+                bool ok = false;
+                int sequence = sequenceText.toInt(&ok);
+                if (ok) {
+                    cancel = CancelToken(
+                            &ClassicPrintDeclarative::previewSequence,
+                            sequence);
+                }
             }
 
-            QImage source(filename);
-            size->setWidth(source.width());
-            size->setHeight(source.height());
+            Source source = loadSource(filename, requestedSize);
+            size->setWidth(source.size.width());
+            size->setHeight(source.size.height());
 
-            QSize targetSize(requestedSize);
+            QSize targetSize(source.scaled.size());
+            QImage photo(source.scaled);
+            if (draft) {
+                photo = photo.scaled(
+                        qMax(1, targetSize.width() /
+                            CLASSICPRINTPROVIDER_DRAFT_DIVISOR),
+                        qMax(1, targetSize.height() /
+                            CLASSICPRINTPROVIDER_DRAFT_DIVISOR),
+                        Qt::KeepAspectRatio,
+                        Qt::SmoothTransformation);
+            }
 
-            if (targetSize.width() == 0) {
-                targetSize.setWidth(source.width()*targetSize.height()/
-                        source.height());
-            } else if (targetSize.height() == 0) {
-                targetSize.setHeight(source.height()*targetSize.width()/
-                        source.width());
+            // A draft renders the same part of its smaller photo
+            QRect photoRegion(region);
+            if (draft && !region.isNull()) {
+                int divisor = CLASSICPRINTPROVIDER_DRAFT_DIVISOR;
+                photoRegion = QRect(region.x() / divisor,
+                        region.y() / divisor,
+                        qMax(1, (region.width() + divisor - 1) / divisor),
+                        qMax(1, (region.height() + divisor - 1) / divisor));
             }
 
-            QImage destination(targetSize, source.format());
+            // The stages of the render are cached under the file and the
+            // sizes it was decoded and scaled to, which stay the same from
+            // one request to the next while the QImage does not
+            QString sourceKey = QString("%1|%2x%3")
+                    .arg(source.identity)
+                    .arg(source.scaled.width())
+                    .arg(source.scaled.height());
+
+            QImage destination;
             ClassicPrintDeclarative::getClassicPrint()->process(
-                    source.scaled(targetSize,
-                        Qt::KeepAspectRatio,
-                        Qt::SmoothTransformation),
-                    targetSize.width(),
-                    targetSize.height(),
-                    destination);
+                    ClassicPrintDeclarative::getPreviewRecipe(),
+                    photo,
+                    photo.width(),
+                    photo.height(),
+                    photoRegion,
+                    destination,
+                    cancel,
+                    sourceKey);
+
+            if (draft && !destination.isNull() && !region.isNull()) {
+                destination = destination.scaled(
+                        destination.size() * CLASSICPRINTPROVIDER_DRAFT_DIVISOR,
+                        Qt::IgnoreAspectRatio,
+                        Qt::SmoothTransformation);
+            }
+            else if (draft && !destination.isNull()) {
+                // Scale the draft up to about the size the full render will
+                // have, frame included, so the layout does not jump
+                int frameWidth = (destination.width() - photo.width()) *
+                    CLASSICPRINTPROVIDER_DRAFT_DIVISOR;
+                destination = destination.scaled(
+                        targetSize.width() + frameWidth,
+                        targetSize.height() + frameWidth,
+                        Qt::IgnoreAspectRatio,
+                        Qt::SmoothTransformation);
+            }
 
             return destination;
         }
@@ -58,6 +136,73 @@ class ClassicPrintProvider : public QDeclarativeImageProvider {
             view->engine()->addImageProvider(QLatin1String("classicPrint"),
                     new ClassicPrintProvider);
         }
+
+    private:
+        // Parse '<x>,<y>,<width>,<height>'. Returns a null rect, which
+        // renders the whole photo, if it is not valid
+        static QRect parseRegion(const QString &text)
+        {
+            QStringList parts = text.split(",");
+            if (parts.size() != 4) {
+                return QRect();
+            }
+            int values[4];
+            for (int i = 0; i < 4; i++) {
+                bool ok = false;
+                values[i] = parts[i].toInt(&ok);
+                if (!ok) {
+                    return QRect();
+                }
+            }
+            if ((values[2] <= 0) || (values[3] <= 0)) {
+                return QRect();
+            }
+            return QRect(values[0], values[1], values[2], values[3]);
+        }
+
+        struct Source {
+            QString identity;   // File name and modification time
+            QSize size;         // Size of the original photo
+            QImage scaled;      // Photo scaled to the requested size
+        };
+
+        // Decode and scale a photo, or reuse the result from an earlier
+        // request. Only the '#sequence' part of the id changes when the
+        // settings do, so the photo itself rarely needs decoding again
+        Source loadSource(const QString &filename, const QSize &requestedSize)
+        {
+            QFileInfo info(filename);
+            QString identity = QString("%1|%2")
+                    .arg(filename)
+                    .arg(info.lastModified().toTime_t());
+            QString key = QString("%1|%2x%3")
+                    .arg(identity)
+                    .arg(requestedSize.width())
+                    .arg(requestedSize.height());
+
+            {
+                QMutexLocker locker(&m_sources_lock);
+                Source *cached = m_sources.object(key);
+                if (cached) {
+                    return *cached;
+                }
+            }
+
+            Source source;
+            source.identity = identity;
+            source.scaled = scaled_decode(filename, requestedSize,
+                    &source.size);
+
+            if (!source.scaled.isNull()) {
+                QMutexLocker locker(&m_sources_lock);
+                m_sources.insert(key, new Source(source),
+                        qMax(1, source.scaled.byteCount() / 1024));
+            }
+            return source;
+        }
+
+        QCache<QString, Source> m_sources;
+        QMutex m_sources_lock;
 };
 
 #endif
@@ -4,29 +4,50 @@
 #include <QtCore>
 
 #include "ClassicPrint.h"
+#include "JpegScanlineStream.h"
 
 class ClassicPrintThread : public QThread {
     public:
         ClassicPrintThread(ClassicPrint *classicPrint,
+                const ClassicPrintRecipe &recipe,
                 QString sourceFilename,
                 QString destinationFilename,
                 QObject *parent=NULL)
             : QThread(parent),
               m_classicPrint(classicPrint),
+              m_recipe(recipe),
               m_sourceFilename(sourceFilename),
               m_destinationFilename(destinationFilename)
         {
         }
 
         void run() {
+            // JPEG to JPEG is streamed through the effects a band of rows
+            // at a time, so the whole photo is never in memory
+            if (isJpeg(m_sourceFilename) && isJpeg(m_destinationFilename)) {
+                JpegScanlineReader reader;
+                if (reader.open(m_sourceFilename)) {
+                    JpegScanlineWriter writer(m_destinationFilename);
+                    if (m_classicPrint->processStream(m_recipe, reader, writer)) {
+                        return;
+                    }
+                }
+            }
+
             QImage source(m_sourceFilename);
-            QImage destination(source.size(), source.format());
-            m_classicPrint->process(source, 0, 0, destination);
+            QImage destination;
+            m_classicPrint->process(m_recipe, source, 0, 0, destination);
             destination.save(m_destinationFilename);
         }
 
     private:
+        static bool isJpeg(const QString &filename) {
+            QString suffix = QFileInfo(filename).suffix().toLower();
+            return (suffix == "jpg" || suffix == "jpeg");
+        }
+
         ClassicPrint *m_classicPrint;
+        ClassicPrintRecipe m_recipe;
         QString m_sourceFilename;
         QString m_destinationFilename;
 };
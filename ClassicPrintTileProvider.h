@@ -0,0 +1,186 @@
+#ifndef CLASSICPRINTQML_CLASSICPRINTTILEPROVIDER_H
+#define CLASSICPRINTQML_CLASSICPRINTTILEPROVIDER_H
+
+#include <QtCore>
+#include <QtGui>
+#include <QtDeclarative>
+
+#include "ClassicPrint.h"
+#include "ClassicPrintDeclarative.h"
+#include "TilePyramid.h"
+
+#include "scaled_decode.h"
+
+// Total size in kilobytes of the processed tiles kept around
+#define CLASSICPRINTTILEPROVIDER_TILE_CACHE_KB (16 * 1024)
+
+// Total size in kilobytes of the photos decoded at the size of a level. A
+// photo at its original size has to fit for its tiles to render quickly
+#define CLASSICPRINTTILEPROVIDER_LEVEL_CACHE_KB (64 * 1024)
+
+// Serves the processed photo as the tiles of a TilePyramid, for the zoomed
+// preview. Ids are '<file>#<sequence>@<level>,<column>,<row>'. A tile only
+// renders its own pixels, which are the same as those of the whole photo
+// processed at the size of the level, so the cost of a tile does not depend
+// on the size of the photo. Tiles are kept, so panning back over them or
+// zooming back to a level does not render them again
+class ClassicPrintTileProvider : public QDeclarativeImageProvider {
+    public:
+        ClassicPrintTileProvider()
+            : QDeclarativeImageProvider(QDeclarativeImageProvider::Image),
+              m_tiles(CLASSICPRINTTILEPROVIDER_TILE_CACHE_KB),
+              m_levels(CLASSICPRINTTILEPROVIDER_LEVEL_CACHE_KB)
+        {
+        }
+
+        QImage requestImage(const QString &id, QSize *size,
+                const QSize &requestedSize)
+        {
+            Q_UNUSED(requestedSize);
+
+            int pos = id.lastIndexOf("#");
+            if (pos == -1) {
+                return QImage();
+            }
+            QString filename = id.mid(0, pos);
+
+            QString tileText = id.mid(pos + 1);
+            int at = tileText.indexOf("@");
+            if (at == -1) {
+                return QImage();
+            }
+            bool ok = false;
+            int sequence = tileText.mid(0, at).toInt(&ok);
+            if (!ok) {
+                return QImage();
+            }
+            QStringList parts = tileText.mid(at + 1).split(",");
+            if (parts.size() != 3) {
+                return QImage();
+            }
+            int values[3];
+            for (int i = 0; i < 3; i++) {
+                values[i] = parts[i].toInt(&ok);
+                if (!ok || (values[i] < 0)) {
+                    return QImage();
+                }
+            }
+            int level = values[0];
+            int column = values[1];
+            int row = values[2];
+
+            QFileInfo info(filename);
+            QString levelKey = QString("%1|%2|%3")
+                    .arg(filename)
+                    .arg(info.lastModified().toTime_t())
+                    .arg(level);
+            QString tileKey = QString("%1|%2|%3,%4")
+                    .arg(levelKey)
+                    .arg(sequence)
+                    .arg(column)
+                    .arg(row);
+
+            {
+                QMutexLocker locker(&m_lock);
+                QImage *cached = m_tiles.object(tileKey);
+                if (cached) {
+                    size->setWidth(cached->width());
+                    size->setHeight(cached->height());
+                    return *cached;
+                }
+            }
+
+            // Give up on this tile once a newer sequence has been asked for
+            CancelToken cancel(&ClassicPrintDeclarative::previewSequence,
+                    sequence);
+            if (cancel.isCancelled()) {
+                return QImage();
+            }
+
+            QImage photo = loadLevel(filename, levelKey, level);
+            if (photo.isNull()) {
+                return QImage();
+            }
+
+            QImage tile;
+            ClassicPrintDeclarative::getClassicPrint()->process(
+                    ClassicPrintDeclarative::getPreviewRecipe(),
+                    photo,
+                    photo.width(),
+                    photo.height(),
+                    QRect(column * TILEPYRAMID_TILE_SIZE,
+                        row * TILEPYRAMID_TILE_SIZE,
+                        TILEPYRAMID_TILE_SIZE,
+                        TILEPYRAMID_TILE_SIZE),
+                    tile,
+                    cancel,
+                    QString("%1|%2x%3")
+                        .arg(levelKey)
+                        .arg(photo.width())
+                        .arg(photo.height()));
+
+            if (!tile.isNull()) {
+                QMutexLocker locker(&m_lock);
+                m_tiles.insert(tileKey, new QImage(tile),
+                        qMax(1, tile.byteCount() / 1024));
+            }
+
+            size->setWidth(tile.width());
+            size->setHeight(tile.height());
+            return tile;
+        }
+
+        static void addToView(QDeclarativeView *view) {
+            view->engine()->addImageProvider(QLatin1String("classicPrintTile"),
+                    new ClassicPrintTileProvider);
+        }
+
+    private:
+        // Decode a photo at the size of a level, or reuse the result from an
+        // earlier tile of the level. The tiles of a level all need the whole
+        // photo, as the blur and the light leak read around them
+        QImage loadLevel(const QString &filename, const QString &key,
+                int level)
+        {
+            {
+                QMutexLocker locker(&m_lock);
+                QImage *cached = m_levels.object(key);
+                if (cached) {
+                    return *cached;
+                }
+            }
+
+            QSize original = image_size(filename);
+            QSize size = TilePyramid::levelSize(original, level);
+            if (!size.isValid()) {
+                return QImage();
+            }
+
+            QImage photo = scaled_decode(filename, size);
+            if (photo.isNull()) {
+                return photo;
+            }
+            // The tiles are laid out for exactly this size
+            if (photo.size() != size) {
+                photo = photo.scaled(size, Qt::IgnoreAspectRatio,
+                        Qt::SmoothTransformation);
+            }
+            // Converted once here instead of by every tile
+            if ((photo.format() != QImage::Format_RGB32) &&
+                    (photo.format() != QImage::Format_ARGB32)) {
+                photo = photo.convertToFormat(photo.hasAlphaChannel() ?
+                        QImage::Format_ARGB32 : QImage::Format_RGB32);
+            }
+
+            QMutexLocker locker(&m_lock);
+            m_levels.insert(key, new QImage(photo),
+                    qMax(1, photo.byteCount() / 1024));
+            return photo;
+        }
+
+        QCache<QString, QImage> m_tiles;
+        QCache<QString, QImage> m_levels;
+        QMutex m_lock;
+};
+
+#endif
@@ -0,0 +1,246 @@
+
+#include "JpegScanlineStream.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+/**
+ * libjpeg reports fatal errors through error_exit, which must not return.
+ * It jumps back to the setjmp() in the call that went wrong instead.
+ *
+ * Nothing with a destructor may be created between a setjmp() and the
+ * libjpeg calls it guards.
+ **/
+struct JpegError {
+    struct jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+struct JpegDecoder {
+    struct jpeg_decompress_struct info;
+    JpegError error;
+    FILE *file;
+    JSAMPROW buffer;
+};
+
+struct JpegEncoder {
+    struct jpeg_compress_struct info;
+    JpegError error;
+    FILE *file;
+    JSAMPROW buffer;
+};
+
+static void
+jpeg_error_exit(j_common_ptr info)
+{
+    char message[JMSG_LENGTH_MAX];
+    (*info->err->format_message)(info, message);
+    qWarning("libjpeg: %s", message);
+    longjmp(((JpegError *)info->err)->jump, 1);
+}
+
+
+JpegScanlineReader::JpegScanlineReader()
+    : m_decoder(NULL)
+{
+}
+
+JpegScanlineReader::~JpegScanlineReader()
+{
+    close();
+}
+
+bool
+JpegScanlineReader::open(const QString &filename)
+{
+    close();
+
+    FILE *file = fopen(QFile::encodeName(filename).constData(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    m_decoder = new JpegDecoder;
+    memset(&m_decoder->info, 0, sizeof(m_decoder->info));
+    m_decoder->file = file;
+    m_decoder->buffer = NULL;
+    m_decoder->info.err = jpeg_std_error(&m_decoder->error.mgr);
+    m_decoder->error.mgr.error_exit = jpeg_error_exit;
+    if (setjmp(m_decoder->error.jump)) {
+        close();
+        return false;
+    }
+
+    jpeg_create_decompress(&m_decoder->info);
+    jpeg_stdio_src(&m_decoder->info, file);
+    jpeg_read_header(&m_decoder->info, TRUE);
+
+    // libjpeg does not convert CMYK to RGB, leave those to QImage
+    if ((m_decoder->info.jpeg_color_space == JCS_CMYK) ||
+            (m_decoder->info.jpeg_color_space == JCS_YCCK)) {
+        close();
+        return false;
+    }
+
+    m_decoder->info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&m_decoder->info);
+    m_decoder->buffer = (*m_decoder->info.mem->alloc_sarray)(
+            (j_common_ptr)&m_decoder->info, JPOOL_IMAGE,
+            m_decoder->info.output_width * m_decoder->info.output_components,
+            1)[0];
+    return true;
+}
+
+QSize
+JpegScanlineReader::size() const
+{
+    if (m_decoder == NULL) {
+        return QSize();
+    }
+    return QSize(m_decoder->info.output_width, m_decoder->info.output_height);
+}
+
+bool
+JpegScanlineReader::readRow(QRgb *row)
+{
+    if ((m_decoder == NULL) ||
+            (m_decoder->info.output_scanline >= m_decoder->info.output_height)) {
+        return false;
+    }
+    if (setjmp(m_decoder->error.jump)) {
+        close();
+        return false;
+    }
+
+    jpeg_read_scanlines(&m_decoder->info, &m_decoder->buffer, 1);
+
+    const JSAMPLE *pixel = m_decoder->buffer;
+    for (unsigned x=0; x<m_decoder->info.output_width; x++, pixel+=3) {
+        row[x] = qRgb(pixel[0], pixel[1], pixel[2]);
+    }
+    return true;
+}
+
+void
+JpegScanlineReader::close()
+{
+    if (m_decoder != NULL) {
+        jpeg_destroy_decompress(&m_decoder->info);
+        fclose(m_decoder->file);
+        delete m_decoder;
+        m_decoder = NULL;
+    }
+}
+
+
+JpegScanlineWriter::JpegScanlineWriter(const QString &filename, int quality)
+    : m_filename(filename),
+      m_quality(quality),
+      m_encoder(NULL)
+{
+}
+
+JpegScanlineWriter::~JpegScanlineWriter()
+{
+    close();
+}
+
+bool
+JpegScanlineWriter::begin(const QSize &size)
+{
+    close();
+
+    FILE *file = fopen(QFile::encodeName(m_filename).constData(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    m_encoder = new JpegEncoder;
+    memset(&m_encoder->info, 0, sizeof(m_encoder->info));
+    m_encoder->file = file;
+    m_encoder->buffer = NULL;
+    m_encoder->info.err = jpeg_std_error(&m_encoder->error.mgr);
+    m_encoder->error.mgr.error_exit = jpeg_error_exit;
+    if (setjmp(m_encoder->error.jump)) {
+        close();
+        return false;
+    }
+
+    jpeg_create_compress(&m_encoder->info);
+    jpeg_stdio_dest(&m_encoder->info, file);
+    m_encoder->info.image_width = size.width();
+    m_encoder->info.image_height = size.height();
+    m_encoder->info.input_components = 3;
+    m_encoder->info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&m_encoder->info);
+    jpeg_set_quality(&m_encoder->info, m_quality, TRUE);
+    jpeg_start_compress(&m_encoder->info, TRUE);
+    m_encoder->buffer = (*m_encoder->info.mem->alloc_sarray)(
+            (j_common_ptr)&m_encoder->info, JPOOL_IMAGE,
+            size.width() * 3, 1)[0];
+    return true;
+}
+
+bool
+JpegScanlineWriter::writeRow(const QRgb *row)
+{
+    if (m_encoder == NULL) {
+        return false;
+    }
+    if (setjmp(m_encoder->error.jump)) {
+        close();
+        return false;
+    }
+
+    JSAMPLE *pixel = m_encoder->buffer;
+    for (unsigned x=0; x<m_encoder->info.image_width; x++, pixel+=3) {
+        pixel[0] = qRed(row[x]);
+        pixel[1] = qGreen(row[x]);
+        pixel[2] = qBlue(row[x]);
+    }
+
+    jpeg_write_scanlines(&m_encoder->info, &m_encoder->buffer, 1);
+    return true;
+}
+
+bool
+JpegScanlineWriter::finish()
+{
+    if (m_encoder == NULL) {
+        return false;
+    }
+    if (setjmp(m_encoder->error.jump)) {
+        close();
+        return false;
+    }
+
+    jpeg_finish_compress(&m_encoder->info);
+    jpeg_destroy_compress(&m_encoder->info);
+
+    bool ok = (ferror(m_encoder->file) == 0);
+    ok = (fclose(m_encoder->file) == 0) && ok;
+    delete m_encoder;
+    m_encoder = NULL;
+
+    if (!ok) {
+        QFile::remove(m_filename);
+    }
+    return ok;
+}
+
+void
+JpegScanlineWriter::close()
+{
+    if (m_encoder != NULL) {
+        jpeg_destroy_compress(&m_encoder->info);
+        fclose(m_encoder->file);
+        delete m_encoder;
+        m_encoder = NULL;
+        QFile::remove(m_filename);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef CLASSICPRINTQML_JPEGSCANLINESTREAM_H
+#define CLASSICPRINTQML_JPEGSCANLINESTREAM_H
+
+#include <QtCore>
+
+#include "ScanlineStream.h"
+
+struct JpegDecoder;
+struct JpegEncoder;
+
+/**
+ * Decodes a JPEG file with libjpeg, one scanline at a time.
+ *
+ * Only one scanline of the photo is held in memory, unlike QImage which
+ * decodes the whole file up front.
+ **/
+class JpegScanlineReader : public ScanlineReader {
+    public:
+        JpegScanlineReader();
+        ~JpegScanlineReader();
+
+        /**
+         * Open a file and read its header. Fails for files that are not
+         * JPEG or can not be decoded to RGB.
+         **/
+        bool open(const QString &filename);
+
+        QSize size() const;
+        bool readRow(QRgb *row);
+
+    private:
+        void close();
+
+        JpegDecoder *m_decoder;
+};
+
+/**
+ * Encodes a JPEG file with libjpeg, one scanline at a time.
+ *
+ * The file is removed again if the writer is destroyed before finish().
+ **/
+class JpegScanlineWriter : public ScanlineWriter {
+    public:
+        /* Quality is 0-100, 75 matches the default of QImage::save() */
+        JpegScanlineWriter(const QString &filename, int quality=75);
+        ~JpegScanlineWriter();
+
+        bool begin(const QSize &size);
+        bool writeRow(const QRgb *row);
+        bool finish();
+
+    private:
+        void close();
+
+        QString m_filename;
+        int m_quality;
+        JpegEncoder *m_encoder;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef CLASSICPRINTQML_TILEPYRAMID_H
+#define CLASSICPRINTQML_TILEPYRAMID_H
+
+#include <QSize>
+
+// Width and height of the tiles of every level
+#define TILEPYRAMID_TILE_SIZE 256
+
+/**
+ * Geometry of the tiles the zoomed preview is made of.
+ *
+ * Level 0 is the photo at its original size, and every level after it is
+ * half the size of the one before, down to the first level that fits into
+ * a single tile. Each level is cut into TILEPYRAMID_TILE_SIZE square tiles
+ * from its top left corner, so a view at any zoom only needs the tiles of
+ * one level that it shows.
+ **/
+class TilePyramid {
+    public:
+        // Size of the photo at a level. The photo is decoded and processed
+        // at exactly this size for the tiles of the level
+        static QSize levelSize(const QSize &original, int level)
+        {
+            if (original.isEmpty() || (level < 0)) {
+                return QSize();
+            }
+            int divisor = 1 << qMin(level, 30);
+            QSize size(original);
+            size.scale(qMax(1, (original.width() + divisor - 1) / divisor),
+                    qMax(1, (original.height() + divisor - 1) / divisor),
+                    Qt::KeepAspectRatio);
+            return size;
+        }
+
+        // Number of levels of a photo
+        static int levelCount(const QSize &original)
+        {
+            if (original.isEmpty()) {
+                return 0;
+            }
+            int levels = 1;
+            QSize size(original);
+            while ((size.width() > TILEPYRAMID_TILE_SIZE) ||
+                    (size.height() > TILEPYRAMID_TILE_SIZE)) {
+                size = levelSize(original, levels);
+                levels++;
+            }
+            return levels;
+        }
+};
+
+#endif
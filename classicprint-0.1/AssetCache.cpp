@@ -0,0 +1,147 @@
+/*!
+** @file	AssetCache.cpp
+**
+** @brief	Decoded images and directory listings of the bundled resources
+**
+*/
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include "AssetCache.h"
+#include <QCache>
+#include <QDir>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+static QMutex                       s_lock;
+
+// Decoded images by filename. The cost is the size in kilobytes
+static QCache<QString, QImage>      s_images(ASSETCACHE_IMAGE_LIMIT);
+
+// Scaled images by filename and size. The cost is the size in kilobytes
+static QCache<QString, QImage>      s_scaled(ASSETCACHE_SCALED_LIMIT);
+
+// Directory listings by directory and filters
+static QHash<QString, QStringList>  s_entries;
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a decoded image
+**
+** @param[In] filename      File to load
+**
+** @return  Image in Format_RGB32, or Format_ARGB32 if it has an alpha
+**          channel. Null if it can not be loaded
+*/
+QImage AssetCache::image(const QString& filename) {
+    {
+        QMutexLocker    locker(&s_lock);
+        QImage*         cached = s_images.object(filename);
+        if (cached) {
+            return *cached;
+        }
+    }
+
+    // Decoded without the lock held so lookups by other threads are not
+    // held up
+    QImage  image(filename);
+    if (!image.isNull()) {
+        QImage::Format  format = image.hasAlphaChannel() ? QImage::Format_ARGB32 :
+                                                           QImage::Format_RGB32;
+        if (image.format() != format) {
+            image = image.convertToFormat(format);
+        }
+    }
+
+    QMutexLocker    locker(&s_lock);
+    // Another thread may have decoded it meanwhile. Its copy is handed out
+    // so every user shares the one buffer
+    QImage* cached = s_images.object(filename);
+    if (cached) {
+        return *cached;
+    }
+    // Failures are remembered too so missing files are not retried
+    s_images.insert(filename, new QImage(image), qMax(1, image.byteCount() / 1024));
+    return image;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a decoded image smoothly scaled to a size
+**
+** @param[In] filename      File to load
+** @param[In] size          Size to scale to, ignoring the aspect ratio
+**
+** @return  Image in the format image() returns. Null if it can not be
+**          loaded
+*/
+QImage AssetCache::scaledImage(const QString& filename, const QSize& size) {
+    QImage  original = image(filename);
+    if (original.isNull() || (original.size() == size)) {
+        return original;
+    }
+
+    QString key = QString("%1:%2x%3").arg(filename).arg(size.width()).arg(size.height());
+    {
+        QMutexLocker    locker(&s_lock);
+        QImage*         cached = s_scaled.object(key);
+        if (cached) {
+            return *cached;
+        }
+    }
+
+    // Scaled without the lock held so other threads are not held up
+    QImage  scaled = original.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    if (scaled.format() != original.format()) {
+        scaled = scaled.convertToFormat(original.format());
+    }
+
+    QMutexLocker    locker(&s_lock);
+    QImage*         cached = s_scaled.object(key);
+    if (cached) {
+        return *cached;
+    }
+    s_scaled.insert(key, new QImage(scaled), qMax(1, scaled.byteCount() / 1024));
+    return scaled;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the files in a directory. The directory is only listed
+**          the first time, so it must not change while running
+**
+** @param[In] dir           Directory to list
+** @param[In] filters       Name filters, e.g. "*.jpg"
+**
+** @return  File names without the directory
+*/
+QStringList AssetCache::entryList(const QString& dir, const QStringList& filters) {
+    QString         key = dir + ":" + filters.join(";");
+    QMutexLocker    locker(&s_lock);
+    QHash<QString, QStringList>::const_iterator found = s_entries.constFind(key);
+    if (found != s_entries.constEnd()) {
+        return found.value();
+    }
+
+    QStringList entries = QDir(dir).entryList(filters);
+    s_entries.insert(key, entries);
+    return entries;
+}
@@ -0,0 +1,92 @@
+/*!
+** @file	AssetCache.h
+**
+** @brief	Decoded images and directory listings of the bundled resources
+**
+*/
+#ifndef __assetcache__h
+#define __assetcache__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+// Most kilobytes of decoded images kept
+#define ASSETCACHE_IMAGE_LIMIT      (16 * 1024)
+
+// Most kilobytes of scaled variants kept
+#define ASSETCACHE_SCALED_LIMIT     (32 * 1024)
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Shared cache of the resources used by the filters.
+**
+** Filters are created for every render, and used to decode the noise
+** texture, light leaks and colour lookup tables each time. The cache
+** decodes each file once and hands out shared copies of it, keeping up to
+** ASSETCACHE_IMAGE_LIMIT of them. Images scaled to a size are kept too, up
+** to ASSETCACHE_SCALED_LIMIT.
+**
+** All functions may be called from several threads at once. The images
+** returned must only be read.
+*/
+class AssetCache {
+public:
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a decoded image
+    **
+    ** @param[In] filename      File to load
+    **
+    ** @return  Image in Format_RGB32, or Format_ARGB32 if it has an alpha
+    **          channel. Null if it can not be loaded
+    */
+    static QImage   image(const QString& filename);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a decoded image smoothly scaled to a size
+    **
+    ** @param[In] filename      File to load
+    ** @param[In] size          Size to scale to, ignoring the aspect ratio
+    **
+    ** @return  Image in the format image() returns. Null if it can not be
+    **          loaded
+    */
+    static QImage   scaledImage(const QString& filename, const QSize& size);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the files in a directory. The directory is only listed
+    **          the first time, so it must not change while running
+    **
+    ** @param[In] dir           Directory to list
+    ** @param[In] filters       Name filters, e.g. "*.jpg"
+    **
+    ** @return  File names without the directory
+    */
+    static QStringList  entryList(const QString& dir, const QStringList& filters);
+};
+
+
+#endif
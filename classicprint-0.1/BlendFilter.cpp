@@ -10,15 +10,30 @@
 */
 #include "BlendFilter.h"
 #include "utils.h"
+#include "AssetCache.h"
+#include "PixelKernels.h"
+#include <QVector>
 #include <stdint.h>
  
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
 */
+
+// Pixels screened at a time by processRow
+#define BLEND_CHUNK		256
  
 /*--------------------------------------------------------------------------- 
 ** Typedefs 
 */ 
+
+// Columns of the blend image that each column of an image of one size is
+// sampled from, the same for every row
+class BlendColumns : public QtImageFilterRowState {
+public:
+	QVector<int>	x0;		// Left blend image column
+	QVector<int>	x1;		// Right blend image column
+	QVector<int>	wx;		// Weight of the right column, out of 256
+};
  
 /*--------------------------------------------------------------------------- 
 ** Local function prototypes 
@@ -39,8 +54,16 @@ BlendFilter::BlendFilter() {
 QImage BlendFilter::apply(
 	const QImage &img,
  	const QRect& clipRect
-        ) const {
-    int x;
+) const {
+	QImage resultImg = img;
+	applyInPlace(resultImg, clipRect);
+	return resultImg;
+}
+
+bool BlendFilter::applyInPlace(
+	QImage &img,
+ 	const QRect& clipRect
+) const {
     int y;
     int top = 0;
     int bottom = img.height();
@@ -51,43 +74,145 @@ QImage BlendFilter::apply(
         // If we have a cliprect, set our coordinates to our cliprect
         // and make sure it is within the boundaries of the image
         top = qMax(top, clipRect.top());
-        bottom = qMin(bottom, clipRect.bottom());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
         left = qMax(left, clipRect.left());
-        right = qMin(right, clipRect.right());
+        right = qMin(right, clipRect.right() + 1);
     }
 
     QImage::Format fmt = img.format();
-    QImage resultImg = img.convertToFormat(QImage::Format_ARGB32);
+    if ((fmt != QImage::Format_RGB32) && (fmt != QImage::Format_ARGB32)) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    }
 
     // Resize the blend image to match the source image
-    QImage resized_image(m_blend_image.scaled(img.width(), img.height(),Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
-
-	uchar* bits = resultImg.bits();
-	const uchar* bits_blend = resized_image.bits();
+    QImage resized_image(blend_image(img.size()));
 
 	for (y = top; y < bottom; y++) {
-        for (x = left; x < right; x++) {
-			// Read the pixel data
-			QRgb rgb_image = ((uint32_t*)bits)[x];
-			QRgb rgb_blend = ((uint32_t*)bits_blend)[x];
-
-            int red = qRed(rgb_image) + qRed(rgb_blend) -
-                         (qRed(rgb_blend) * qRed(rgb_image) / 255.0);
-            int green = qGreen(rgb_image) + qGreen(rgb_blend) -
-                         (qGreen(rgb_blend) * qGreen(rgb_image) / 255.0);
-            int blue = qBlue(rgb_image) + qBlue(rgb_blend) -
-                         (qBlue(rgb_blend) * qBlue(rgb_image) / 255.0);
-
-			((uint32_t*)bits)[x] = qRgb(red, green, blue);
-		}
-		bits += resultImg.bytesPerLine();
-		bits_blend += resized_image.bytesPerLine();
+		process_row((QRgb*)img.scanLine(y),
+					(const QRgb*)resized_image.scanLine(y), left, right);
 	}
-    
-    if (resultImg.format() != fmt) {
-        resultImg = resultImg.convertToFormat(fmt);
+
+    if (img.format() != fmt) {
+        img = img.convertToFormat(fmt);
     }
-    return resultImg;
+    return true;
+}
+
+QImage BlendFilter::blend_image(
+	const QSize& size
+) const {
+	return AssetCache::scaledImage(m_blend_filename, size);
+}
+
+QSharedPointer<const QtImageFilterRowState> BlendFilter::prepareRows(
+	const QSize& size
+) const {
+	if (isIdentity() || size.isEmpty()) {
+		return QSharedPointer<const QtImageFilterRowState>();
+	}
+	int src_width = m_blend_image.width();
+
+	// Pixel centres of the scaled image mapped back into the blend image, in
+	// 16.16 fixed point
+	BlendColumns* columns = new BlendColumns;
+	columns->x0.resize(size.width());
+	columns->x1.resize(size.width());
+	columns->wx.resize(size.width());
+	qint64 step_x = ((qint64)src_width << 16) / size.width();
+	qint64 sx = step_x / 2 - 0x8000;
+	for (int x = 0; x < size.width(); x++, sx += step_x) {
+		int fx = qBound(0, (int)sx, (src_width - 1) << 16);
+		columns->x0[x] = fx >> 16;
+		columns->x1[x] = qMin(columns->x0[x] + 1, src_width - 1);
+		columns->wx[x] = (fx >> 8) & 0xff;
+	}
+	return QSharedPointer<const QtImageFilterRowState>(columns);
+}
+
+void BlendFilter::blend_row(
+	const QSize& size,
+	int y,
+	QRgb* row,
+	int left,
+	int right,
+	const QtImageFilterRowState* state
+) const {
+	const BlendColumns* columns = static_cast<const BlendColumns*>(state);
+	int src_height = m_blend_image.height();
+
+	// Pixel centres of the scaled image mapped back into the blend image, in
+	// 16.16 fixed point
+	qint64 step_y = ((qint64)src_height << 16) / size.height();
+	int fy = (int)(y * step_y + step_y / 2) - 0x8000;
+	fy = qBound(0, fy, (src_height - 1) << 16);
+	int y0 = fy >> 16;
+	int y1 = qMin(y0 + 1, src_height - 1);
+	int wy = (fy >> 8) & 0xff;
+
+	const QRgb* top = (const QRgb*)m_blend_image.constScanLine(y0);
+	const QRgb* bottom = (const QRgb*)m_blend_image.constScanLine(y1);
+
+	for (int x = left; x < right; x++) {
+		int x0 = columns->x0[x];
+		int x1 = columns->x1[x];
+		int wx = columns->wx[x];
+
+		int red = 0;
+		int green = 0;
+		int blue = 0;
+		QRgb corners[4] = { top[x0], top[x1], bottom[x0], bottom[x1] };
+		int weights[4] = { (256 - wx) * (256 - wy), wx * (256 - wy),
+						   (256 - wx) * wy, wx * wy };
+		for (int i = 0; i < 4; i++) {
+			red += qRed(corners[i]) * weights[i];
+			green += qGreen(corners[i]) * weights[i];
+			blue += qBlue(corners[i]) * weights[i];
+		}
+		row[x - left] = qRgb((red + 0x8000) >> 16, (green + 0x8000) >> 16, (blue + 0x8000) >> 16);
+	}
+}
+
+void BlendFilter::process_row(
+	QRgb* row,
+	const QRgb* blend_row,
+	int left,
+	int right
+) const {
+	screen_row(row + left, blend_row + left, right - left);
+}
+
+QtImageFilter::FilterKind
+BlendFilter::kind(
+) const {
+	return PointwiseFilter;
+}
+
+bool
+BlendFilter::isIdentity(
+) const {
+	return m_blend_image.isNull();
+}
+
+void
+BlendFilter::processRow(
+	QRgb* row,
+	int y,
+	int left,
+	int right,
+	const QSize& size,
+	const QtImageFilterRowState* state
+) const {
+	if (!state) {
+		return;
+	}
+	// The light leak is resampled a chunk at a time, so no row of it is
+	// ever held
+	QRgb blend[BLEND_CHUNK];
+	for (int x = left; x < right; x += BLEND_CHUNK) {
+		int count = qMin(BLEND_CHUNK, right - x);
+		blend_row(size, y, blend, x, x + count, state);
+		screen_row(row + x, blend, count);
+	}
 }
 
 QString
@@ -113,7 +238,7 @@ BlendFilter::setOption(
 ) {
     if (filteroption == BlendImage) {
         m_blend_filename = value.toString();
-        m_blend_image.load(m_blend_filename);
+        m_blend_image = AssetCache::image(m_blend_filename);
         if (m_blend_image.isNull()) {
             return false;
         }
@@ -41,6 +41,32 @@ public:
 
 	virtual QImage apply(const QImage &img, const QRect& clipRect = QRect()) const;
 
+	virtual bool applyInPlace(QImage &img, const QRect& clipRect = QRect()) const;
+
+	// Blend image scaled to the given size, in a 32-bit format
+	QImage blend_image(const QSize& size) const;
+
+	// Columns of the blend image sampled for an image of the given size
+	virtual QSharedPointer<const QtImageFilterRowState> prepareRows(const QSize &size) const;
+
+	// Pixels [left, right) of one scanline of the blend image scaled to the
+	// given size into row[0, right - left), with the columns from
+	// prepareRows(). Sampled bilinearly, so it is close to but not exactly
+	// the same as blend_image
+	void blend_row(const QSize& size, int y, QRgb* row, int left, int right,
+				   const QtImageFilterRowState* state) const;
+
+	// Screen blend_row over pixels [left, right) of one scanline in place
+	void process_row(QRgb* row, const QRgb* blend_row, int left, int right) const;
+
+	virtual FilterKind kind() const;
+
+	virtual bool isIdentity() const;
+
+	// Screen the light leak over pixels [left, right) of one scanline
+	virtual void processRow(QRgb *row, int y, int left, int right, const QSize &size,
+							const QtImageFilterRowState *state) const;
+
 	virtual QString name() const;
 
 	virtual QVariant option(int filteroption) const;
@@ -0,0 +1,79 @@
+/*!
+** @file	CancelToken.h
+**
+** @brief	Lets a caller abandon a render that is no longer wanted
+**
+*/
+#ifndef __canceltoken__h
+#define __canceltoken__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QAtomicInt>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Cancellation token for a render.
+**
+** The token watches a generation counter owned by whoever starts renders.
+** It is cancelled as soon as that counter moves away from the value it was
+** created with, so bumping the counter abandons every render started for
+** an older generation. A default constructed token is never cancelled.
+*/
+class CancelToken {
+public:
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Constructor for a token that is never cancelled
+    **
+    */
+    CancelToken()
+        : m_generation(NULL), m_expected(0) {
+    }
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Constructor
+    **
+    ** @param[In] generation    Counter to watch. Must outlive the token
+    ** @param[In] expected      Generation the render was started for
+    **
+    */
+    CancelToken(const QAtomicInt* generation, int expected)
+        : m_generation(generation), m_expected(expected) {
+    }
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   See if the render should be abandoned
+    **
+    ** @return True if the generation has moved on
+    */
+    bool isCancelled() const {
+        return m_generation && ((int)*m_generation != m_expected);
+    }
+
+private:
+    const QAtomicInt*   m_generation;
+    int                 m_expected;
+};
+
+
+#endif
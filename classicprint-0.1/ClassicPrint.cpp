@@ -12,6 +12,7 @@
 #include "ClassicPrintFilm.h"
 #include "ClassicPrintLens.h"
 #include "ClassicPrintProcessing.h"
+#include "ClassicPrintEngine.h"
 #include "utils.h"
 
 /* Filters for ClassicPrint::init() */
@@ -26,6 +27,7 @@
 #include <QDomDocument>
 #include <QDomElement>
 #include <QFile>
+#include <QThread>
 #include <QDebug>
 
 /*--------------------------------------------------------------------------- 
@@ -56,6 +58,10 @@ ClassicPrint::ClassicPrint() {
 	m_save_width = 0;
 	m_save_height = 0;
 
+	// Split processing over all cores by default
+	m_thread_pool = new QThreadPool(this);
+	setThreadCount(0);
+
 	// Load the colour profiles
 	loadColourProfiles();
 }
@@ -73,59 +79,229 @@ ClassicPrint::~ClassicPrint() {
 
 //---------------------------------------------------------------------------
 /*!
-** @brief   Process a photo
+** @brief   Process a photo with the current lens, film and processing
 **
 ** @param[In] photo     Photo to process
 ** @param[In] width     Width of output image. Set to 0 to use original width
 ** @param[In] height    Height of output image. Set to 0 to use original height
 ** @param[out] processed On return contains processed photo
+** @param[In] cancel    Token to abandon processing when the result is no
+**                      longer wanted
+** @param[In] source    Identity of the photo that stays the same between
+**                      calls, such as its file name, modification time and
+**                      decoded size. The output of each stage is kept for
+**                      later calls with the same source. Empty keeps none
 **
-** @return True/False
+** @return True/False. False if processing was cancelled
+*/
+bool ClassicPrint::process(const QImage& photo, int width, int height, QImage& processed,
+                           const CancelToken& cancel, const QString& source) {
+    return process(recipe(), photo, width, height, processed, cancel, source);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Process a photo with a snapshot of the settings. This may be
+**          called from several threads at once
+**
+** @param[In] recipe    Settings to process with
+** @param[In] photo     Photo to process
+** @param[In] width     Width of output image. Set to 0 to use original width
+** @param[In] height    Height of output image. Set to 0 to use original height
+** @param[out] processed On return contains processed photo
+** @param[In] cancel    Token to abandon processing when the result is no
+**                      longer wanted
+** @param[In] source    Identity of the photo that stays the same between
+**                      calls, such as its file name, modification time and
+**                      decoded size. The output of each stage is kept for
+**                      later calls with the same source. Empty keeps none
+**
+** @return True/False. False if processing was cancelled
+*/
+bool ClassicPrint::process(const ClassicPrintRecipe& recipe, const QImage& photo,
+                           int width, int height, QImage& processed,
+                           const CancelToken& cancel, const QString& source) {
+    return process(recipe, photo, width, height, QRect(), processed, cancel, source);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Process part of a photo with a snapshot of the settings. The
+**          pixels are the same as those of the same part of the whole
+**          processed photo, but only the region is rendered, so a zoomed
+**          in view only costs the pixels that are visible. This may be
+**          called from several threads at once
+**
+** @param[In] recipe    Settings to process with
+** @param[In] photo     Photo to process
+** @param[In] width     Width of output image. Set to 0 to use original width
+** @param[In] height    Height of output image. Set to 0 to use original height
+** @param[In] region    Part of the output image, frame included, to render.
+**                      A null rect renders all of it
+** @param[out] processed On return contains the processed region
+** @param[In] cancel    Token to abandon processing when the result is no
+**                      longer wanted
+** @param[In] source    Identity of the photo that stays the same between
+**                      calls, such as its file name, modification time and
+**                      decoded size. The output of each stage is kept for
+**                      later calls with the same source, but only read
+**                      when a region is given. Empty keeps none
+**
+** @return True/False. False if processing was cancelled or the region
+**         is outside the output image
 */
-bool ClassicPrint::process(const QImage& photo, int width, int height, QImage& processed) {
-    emit working(true);
-    bool result = process_real(photo, width, height, processed);
-    emit working(false);
+bool ClassicPrint::process(const ClassicPrintRecipe& recipe, const QImage& photo,
+                           int width, int height, const QRect& region, QImage& processed,
+                           const CancelToken& cancel, const QString& source) {
+    // Only the first of several overlapping calls reports working
+    if (m_active.fetchAndAddOrdered(1) == 0) {
+        emit working(true);
+    }
+    bool result = process_real(recipe, photo, width, height, region, processed, cancel, source);
+    if (m_active.fetchAndAddOrdered(-1) == 1) {
+        emit working(false);
+    }
     return result;
 }
 
-bool ClassicPrint::process_real(const QImage& photo, int width, int height, QImage& processed) {
-    if (!m_current_lens || !m_current_film || !m_current_processing) {
+bool ClassicPrint::process_real(const ClassicPrintRecipe& recipe, const QImage& photo,
+                                int width, int height, const QRect& region,
+                                QImage& processed, const CancelToken& cancel,
+                                const QString& source) {
+    if (!recipe.isValid()) {
         return false;
     }
-    // See if we have to scale the image
+    QSize   size = photo.size();
     if ((width > 0) && (height > 0)) {
-        processed = photo.scaled(width, height, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        size.scale(width, height, Qt::KeepAspectRatio);
     }
-    else {
-        processed = photo;
+
+    // Stages are cached by the identity the caller gives the photo, as the
+    // image passed in is often a new copy for every call
+    QString source_key;
+    if (!source.isEmpty()) {
+        source_key = QString("source %1 %2x%3").arg(source).arg(size.width()).arg(size.height());
     }
 
-    connect(m_current_lens, SIGNAL(progress(int)), this, SLOT(progress_lens(int)));
-    connect(m_current_film, SIGNAL(progress(int)), this, SLOT(progress_film(int)));
-    connect(m_current_processing, SIGNAL(progress(int)), this, SLOT(progress_processing(int)));
+    // The scaled photo is the first stage kept in the stage cache, so it is
+    // only scaled again when the photo or the size changes. Renders of a
+    // part of the photo only read the cache, so tiles do not fill it with
+    // whole photos
+    QImage  scaled = photo;
+    if (size != photo.size()) {
+        if (source_key.isEmpty() || !m_stage_cache.find(source_key, scaled)) {
+            scaled = photo.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            if (!source_key.isEmpty() && region.isNull()) {
+                m_stage_cache.insert(source_key, scaled);
+            }
+        }
+    }
 
-    // Apply the lens first of all
-    if (!m_current_lens->process(processed)) {
-        qDebug() << "lens failed";
+    // Lens, film and processing are applied in a single pass, from the last
+    // stage whose settings changed
+    ClassicPrintEngine  engine(recipe, &m_filter_pool);
+    if (m_thread_pool->maxThreadCount() > 1) {
+        engine.setThreadPool(m_thread_pool);
+    }
+    engine.setBufferPool(&m_buffer_pool);
+    engine.setStageCache(&m_stage_cache, source_key);
+    engine.setCancelToken(cancel);
+    if (!engine.processRegion(scaled, region, processed, on_progress, this)) {
+        if (!cancel.isCancelled()) {
+            qDebug() << "processing failed";
+        }
         return false;
     }
-    // Then the film
-    if (!m_current_film->process(processed)) {
-        qDebug() << "film failed";
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Process a photo read and written one scanline at a time, at its
+**          original size. Only a band of rows is held in memory at once.
+**          This may be called from several threads at once
+**
+** @param[In] recipe    Settings to process with
+** @param[In] reader    Photo to process
+** @param[In] writer    Destination of the processed photo
+** @param[In] cancel    Token to abandon processing when the result is no
+**                      longer wanted
+**
+** @return True/False. False if processing was cancelled
+*/
+bool ClassicPrint::processStream(const ClassicPrintRecipe& recipe, ScanlineReader& reader,
+                                 ScanlineWriter& writer, const CancelToken& cancel) {
+    if (!recipe.isValid()) {
         return false;
     }
-    // And finally the processing
-    if (!m_current_processing->process(processed)) {
+
+    if (m_active.fetchAndAddOrdered(1) == 0) {
+        emit working(true);
+    }
+
+    ClassicPrintEngine  engine(recipe, &m_filter_pool);
+    if (m_thread_pool->maxThreadCount() > 1) {
+        engine.setThreadPool(m_thread_pool);
+    }
+    engine.setBufferPool(&m_buffer_pool);
+    engine.setCancelToken(cancel);
+    bool    result = engine.processStream(reader, writer, on_progress, this);
+    if (!result && !cancel.isCancelled()) {
         qDebug() << "processing failed";
-        return false;
     }
 
-    disconnect(m_current_lens, SIGNAL(progress(int)), this, SLOT(progress_lens(int)));
-    disconnect(m_current_film, SIGNAL(progress(int)), this, SLOT(progress_film(int)));
-    disconnect(m_current_processing, SIGNAL(progress(int)), this, SLOT(progress_processing(int)));
+    if (m_active.fetchAndAddOrdered(-1) == 1) {
+        emit working(false);
+    }
+    return result;
+}
 
-    return true;
+//---------------------------------------------------------------------------
+/*!
+** @brief   Take a snapshot of the current lens, film and processing.
+**          Must be called from the thread that changes the settings.
+**          A "Random" light leak is picked now, so every render with
+**          the snapshot applies the same one
+**
+** @return  Recipe. Empty if no lens, film or processing is selected
+*/
+ClassicPrintRecipe ClassicPrint::recipe() {
+    if (!m_current_lens || !m_current_film || !m_current_processing) {
+        return ClassicPrintRecipe();
+    }
+
+    ClassicPrintLens* lens = new ClassicPrintLens;
+    *lens = *m_current_lens;
+    ClassicPrintFilm* film = new ClassicPrintFilm;
+    *film = *m_current_film;
+    ClassicPrintProcessing* processing = new ClassicPrintProcessing(this);
+    *processing = *m_current_processing;
+    // Renders of parts of the photo must all apply the same light leak
+    processing->pickRandomLightLeak();
+
+    return ClassicPrintRecipe(lens, film, processing);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the size of a processed photo, frame included
+**
+** @param[In] recipe    Settings to process with
+** @param[In] size      Size of the photo passed to process()
+**
+** @return  Size, or an invalid size if the recipe is empty
+*/
+QSize ClassicPrint::processedSize(const ClassicPrintRecipe& recipe, const QSize& size) {
+    if (!recipe.isValid()) {
+        return QSize();
+    }
+    QSharedPointer<const FrameFilter> frame = recipe.processing()->frameFilter(m_filter_pool);
+    if (!frame) {
+        return QSize();
+    }
+    int frame_width = frame->frame_width(size);
+    return QSize(size.width() + frame_width * 2, size.height() + frame_width * 2);
 }
 
 //---------------------------------------------------------------------------
@@ -623,18 +799,12 @@ ClassicPrintProcessing* ClassicPrint::getCurrentProcessing() {
     return m_current_processing;
 }
 
-// Progress handling functions. The various functions are weighted
-// depending on average how long they take
-void ClassicPrint::progress_lens(int percent) {
-    emit progress(percent / 8);
-}
-
-void ClassicPrint::progress_film(int percent) {
-    emit progress(percent / 8 + (100 / 8));
-}
-
-void ClassicPrint::progress_processing(int percent) {
-    emit progress(percent / 2 + 50);
+//---------------------------------------------------------------------------
+/*!
+** @brief   Progress handler
+*/
+void ClassicPrint::on_progress(int pr, void* context) {
+    ((ClassicPrint*)context)->emit progress(pr);
 }
 
 //---------------------------------------------------------------------------
@@ -644,12 +814,12 @@ void ClassicPrint::progress_processing(int percent) {
 ** @return  Colour profile. If the name is not found then a default
 **			colour profile is returned
 */
-QList<QVariant> ClassicPrint::getColourProfile(const QString& name) {
+QList<QVariant> ClassicPrint::getColourProfile(const QString& name) const {
 	QList<QVariant> result;
 
-	QMap< QString, QList< QVariant > >::iterator it;
-	it = m_colour_profiles.find(name);
-	if (it != m_colour_profiles.end()) {
+	QMap< QString, QList< QVariant > >::const_iterator it;
+	it = m_colour_profiles.constFind(name);
+	if (it != m_colour_profiles.constEnd()) {
 		return it.value();
 	}
 
@@ -839,6 +1009,73 @@ int ClassicPrint::saveHeight() {
 	return m_save_height;
 }
 
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the number of threads used to process a photo
+**
+** @param[In] count	Number of threads. 0 uses one per core, 1 processes
+**					in the calling thread
+*/
+void ClassicPrint::setThreadCount(int count) {
+	if (count <= 0) {
+		count = QThread::idealThreadCount();
+	}
+	m_thread_pool->setMaxThreadCount(qMax(1, count));
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the number of threads used to process a photo
+**
+** @return	Number of threads
+*/
+int ClassicPrint::threadCount() {
+	return m_thread_pool->maxThreadCount();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the most memory kept for reuse by intermediate images
+**          once a photo has been processed
+**
+** @param[In] limit	Limit in kilobytes. 0 frees them after every photo
+*/
+void ClassicPrint::setBufferPoolLimit(int limit) {
+	m_buffer_pool.setLimit(qMax(0, limit));
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the most memory kept for reuse by intermediate images
+**
+** @return	Limit in kilobytes
+*/
+int ClassicPrint::bufferPoolLimit() {
+	return m_buffer_pool.limit();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the most memory kept by the outputs of each stage of recent
+**          renders, so that a change to one setting only reruns the stages
+**          from that one on
+**
+** @param[In] limit	Limit in kilobytes. 0 reruns every stage every time
+*/
+void ClassicPrint::setStageCacheLimit(int limit) {
+	m_stage_cache.setLimit(qMax(0, limit));
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the most memory kept by the outputs of each stage
+**
+** @return	Limit in kilobytes
+*/
+int ClassicPrint::stageCacheLimit() {
+	return m_stage_cache.limit();
+}
+
 void ClassicPrint::init() {
         REGISTER_LEVELS_FILTER;
         REGISTER_VIGNETTE_FILTER;
@@ -847,5 +1084,8 @@ void ClassicPrint::init() {
         REGISTER_CONTRAST_FILTER;
         REGISTER_COLOUR_LOOKUP_FILTER;
         REGISTER_BLEND_FILTER;
+
+        // Index the light leaks now rather than on the first render
+        ClassicPrintProcessing::lightLeaks();
 }
 
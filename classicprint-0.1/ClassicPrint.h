@@ -15,7 +15,13 @@
 #include <QObject>
 #include <QList>
 #include <QVariant>
+#include <QThreadPool>
 #include <QMap>
+#include "CancelToken.h"
+#include "ClassicPrintRecipe.h"
+#include "ImageBufferPool.h"
+#include "StageCache.h"
+#include "FilterPool.h"
 
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
@@ -27,6 +33,8 @@
 class ClassicPrintFilm;
 class ClassicPrintLens;
 class ClassicPrintProcessing;
+class ScanlineReader;
+class ScanlineWriter;
  
 /*--------------------------------------------------------------------------- 
 ** Local function prototypes 
@@ -55,17 +63,120 @@ public:
 
     //---------------------------------------------------------------------------
     /*!
-    ** @brief   Process a photo
+    ** @brief   Process a photo with the current lens, film and processing
     **
     ** @param[In] photo     Photo to process
     ** @param[In] width     Width of output image. Set to 0 to use original width
     ** @param[In] height    Height of output image. Set to 0 to use original height
     ** @param[out] processed On return contains processed photo
+    ** @param[In] cancel    Token to abandon processing when the result is no
+    **                      longer wanted
+    ** @param[In] source    Identity of the photo that stays the same between
+    **                      calls, such as its file name, modification time and
+    **                      decoded size. The output of each stage is kept for
+    **                      later calls with the same source. Empty keeps none
+    **
+    ** @return True/False. False if processing was cancelled
+    */
+    bool    process(const QImage& photo, int width, int height, QImage& processed,
+                    const CancelToken& cancel = CancelToken(),
+                    const QString& source = QString());
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Process a photo with a snapshot of the settings. This may be
+    **          called from several threads at once
     **
-    ** @return True/False
+    ** @param[In] recipe    Settings to process with
+    ** @param[In] photo     Photo to process
+    ** @param[In] width     Width of output image. Set to 0 to use original width
+    ** @param[In] height    Height of output image. Set to 0 to use original height
+    ** @param[out] processed On return contains processed photo
+    ** @param[In] cancel    Token to abandon processing when the result is no
+    **                      longer wanted
+    ** @param[In] source    Identity of the photo that stays the same between
+    **                      calls, such as its file name, modification time and
+    **                      decoded size. The output of each stage is kept for
+    **                      later calls with the same source. Empty keeps none
+    **
+    ** @return True/False. False if processing was cancelled
+    */
+    bool    process(const ClassicPrintRecipe& recipe, const QImage& photo,
+                    int width, int height, QImage& processed,
+                    const CancelToken& cancel = CancelToken(),
+                    const QString& source = QString());
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Process part of a photo with a snapshot of the settings. The
+    **          pixels are the same as those of the same part of the whole
+    **          processed photo, but only the region is rendered, so a zoomed
+    **          in view only costs the pixels that are visible. This may be
+    **          called from several threads at once
+    **
+    ** @param[In] recipe    Settings to process with
+    ** @param[In] photo     Photo to process
+    ** @param[In] width     Width of output image. Set to 0 to use original width
+    ** @param[In] height    Height of output image. Set to 0 to use original height
+    ** @param[In] region    Part of the output image, frame included, to render.
+    **                      A null rect renders all of it
+    ** @param[out] processed On return contains the processed region
+    ** @param[In] cancel    Token to abandon processing when the result is no
+    **                      longer wanted
+    ** @param[In] source    Identity of the photo that stays the same between
+    **                      calls, such as its file name, modification time and
+    **                      decoded size. The output of each stage is kept for
+    **                      later calls with the same source, but only read
+    **                      when a region is given. Empty keeps none
+    **
+    ** @return True/False. False if processing was cancelled or the region
+    **         is outside the output image
+    */
+    bool    process(const ClassicPrintRecipe& recipe, const QImage& photo,
+                    int width, int height, const QRect& region, QImage& processed,
+                    const CancelToken& cancel = CancelToken(),
+                    const QString& source = QString());
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Process a photo read and written one scanline at a time, at its
+    **          original size. Only a band of rows is held in memory at once.
+    **          This may be called from several threads at once
+    **
+    ** @param[In] recipe    Settings to process with
+    ** @param[In] reader    Photo to process
+    ** @param[In] writer    Destination of the processed photo
+    ** @param[In] cancel    Token to abandon processing when the result is no
+    **                      longer wanted
+    **
+    ** @return True/False. False if processing was cancelled
+    */
+    bool    processStream(const ClassicPrintRecipe& recipe, ScanlineReader& reader,
+                          ScanlineWriter& writer,
+                          const CancelToken& cancel = CancelToken());
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Take a snapshot of the current lens, film and processing.
+    **          Must be called from the thread that changes the settings.
+    **          A "Random" light leak is picked now, so every render with
+    **          the snapshot applies the same one
+    **
+    ** @return  Recipe. Empty if no lens, film or processing is selected
     */
-    bool    process_real(const QImage& photo, int width, int height, QImage& processed);
-    bool    process(const QImage& photo, int width, int height, QImage& processed);
+    ClassicPrintRecipe  recipe();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the size of a processed photo, frame included. This may be
+    **          called from several threads at once
+    **
+    ** @param[In] recipe    Settings to process with
+    ** @param[In] size      Size of the photo passed to process()
+    **
+    ** @return  Size, or an invalid size if the recipe is empty
+    */
+    QSize   processedSize(const ClassicPrintRecipe& recipe, const QSize& size);
 
     //---------------------------------------------------------------------------
     /*!
@@ -241,7 +352,7 @@ public:
 	** @return  Colour profile. If the name is not found then a default
 	**			colour profile is returned
 	*/
-	QList<QVariant> getColourProfile(const QString& name);
+	QList<QVariant> getColourProfile(const QString& name) const;
 
 	//---------------------------------------------------------------------------
 	/*!
@@ -323,6 +434,58 @@ public:
 	*/
 	int saveHeight();
 
+	//---------------------------------------------------------------------------
+	/*!
+	** @brief   Set the number of threads used to process a photo
+	**
+	** @param[In] count	Number of threads. 0 uses one per core, 1 processes
+	**					in the calling thread
+	*/
+	void setThreadCount(int count);
+
+	//---------------------------------------------------------------------------
+	/*!
+	** @brief   Get the number of threads used to process a photo
+	**
+	** @return	Number of threads
+	*/
+	int threadCount();
+
+	//---------------------------------------------------------------------------
+	/*!
+	** @brief   Set the most memory kept for reuse by intermediate images
+	**          once a photo has been processed
+	**
+	** @param[In] limit	Limit in kilobytes. 0 frees them after every photo
+	*/
+	void setBufferPoolLimit(int limit);
+
+	//---------------------------------------------------------------------------
+	/*!
+	** @brief   Get the most memory kept for reuse by intermediate images
+	**
+	** @return	Limit in kilobytes
+	*/
+	int bufferPoolLimit();
+
+	//---------------------------------------------------------------------------
+	/*!
+	** @brief   Set the most memory kept by the outputs of each stage of recent
+	**          renders, so that a change to one setting only reruns the stages
+	**          from that one on
+	**
+	** @param[In] limit	Limit in kilobytes. 0 reruns every stage every time
+	*/
+	void setStageCacheLimit(int limit);
+
+	//---------------------------------------------------------------------------
+	/*!
+	** @brief   Get the most memory kept by the outputs of each stage
+	**
+	** @return	Limit in kilobytes
+	*/
+	int stageCacheLimit();
+
         /* Initializes all filters */
         static void init();
 
@@ -330,10 +493,17 @@ signals:
     void    progress(int percent);
     void    working(bool working);
 
-private slots:
-    void    progress_lens(int percent);
-    void    progress_film(int percent);
-    void    progress_processing(int percent);
+private:
+    bool    process_real(const ClassicPrintRecipe& recipe, const QImage& photo,
+                         int width, int height, const QRect& region,
+                         QImage& processed, const CancelToken& cancel,
+                         const QString& source);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Progress handler
+    */
+    static void on_progress(int pr, void* context);
 
 private:
     QMap<QString, ClassicPrintLens*>        m_lenses;
@@ -350,6 +520,16 @@ private:
 	QString									m_save_folder;
 	int										m_save_width;
 	int										m_save_height;
+
+	QThreadPool*							m_thread_pool;
+	ImageBufferPool							m_buffer_pool;
+	StageCache								m_stage_cache;
+
+	// Configured filters shared by renders with the same settings
+	FilterPool								m_filter_pool;
+
+	// Number of process() calls in progress
+	QAtomicInt								m_active;
 };
 
 
@@ -0,0 +1,594 @@
+/*!
+** @file	ClassicPrintEngine.cpp
+**
+** @brief	Single pass renderer for the lens, film and processing effects
+**
+*/
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include "ClassicPrintEngine.h"
+#include "ClassicPrintRecipe.h"
+#include "ClassicPrintLens.h"
+#include "ClassicPrintFilm.h"
+#include "ClassicPrintProcessing.h"
+#include "FrameFilter.h"
+#include "ScanlineStream.h"
+#include "ImageBufferPool.h"
+#include "StageCache.h"
+#include "FilterPool.h"
+
+#include <QMutex>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QVarLengthArray>
+
+#include <string.h>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+// Stages a render can start from
+enum EngineStage {
+    STAGE_SOURCE,       // The photo. Every stage is run
+    STAGE_FILM,         // Output of the lens and film
+    STAGE_PROCESSED     // Output of the processing. Only the frame is run
+};
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   State shared by all strips of one ClassicPrintEngine::process call
+*/
+struct EngineJob {
+    const ClassicPrintEngine*   engine;
+    const ScanlineWindow*       source;
+    QSize                       size;
+    int                         frame_width;
+
+    // Stage the source rows are the output of
+    int                         first_stage;
+
+    // What the film and processing stages worked out for the photo size
+    FilterGraph::RowStates      film_states;
+    FilterGraph::RowStates      processing_states;
+
+    // Rows of the film stage output to keep, or NULL
+    uchar*                      film_bits;
+    int                         film_bytes_per_line;
+
+    // Output rows, used as a ring of the given number of rows from top
+    uchar*                      bits;
+    int                         bytes_per_line;
+    int                         rows;
+    int                         top;
+    int                         height;
+
+    // Columns [left, right) of the framed image, which is framed_width
+    // wide, are rendered. Those are columns [photo_left, photo_right) of
+    // the photo
+    int                         left;
+    int                         right;
+    int                         framed_width;
+    int                         photo_left;
+    int                         photo_right;
+
+    void                        (*progress)(int, void*);
+    void*                       context;
+    QMutex                      progress_lock;
+    int                         rows_done;
+    QSemaphore                  strips_done;
+};
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Renders a range of output rows. Rows only depend on the photo and
+**          the row number so strips may run in any order on any thread
+*/
+class EngineStrip : public QRunnable {
+public:
+    EngineStrip(EngineJob* job, int top, int bottom)
+        : m_job(job), m_top(top), m_bottom(bottom) {
+    }
+
+    void run() {
+        // Rows are rendered the whole width of the framed image, so a part
+        // of it is rendered into a line and copied out
+        int     width = m_job->right - m_job->left;
+        QVarLengthArray<QRgb, 1024> line((width < m_job->framed_width) ? m_job->framed_width : 0);
+
+        for (int y = m_top; y < m_bottom; y++) {
+            if (m_job->engine->m_cancel.isCancelled()) {
+                m_job->strips_done.release();
+                return;
+            }
+            QRgb*   row = (QRgb*)(m_job->bits + ((y - m_job->top) % m_job->rows) * m_job->bytes_per_line);
+            if (line.size() > 0) {
+                m_job->engine->process_row(*m_job, y, line.data());
+                memcpy(row, line.constData() + m_job->left, width * sizeof(QRgb));
+            }
+            else {
+                m_job->engine->process_row(*m_job, y, row);
+            }
+        }
+
+        if (m_job->progress) {
+            QMutexLocker    locker(&m_job->progress_lock);
+            m_job->rows_done += m_bottom - m_top;
+            m_job->progress(m_job->rows_done * 100 / m_job->height, m_job->context);
+        }
+        m_job->strips_done.release();
+    }
+
+private:
+    EngineJob*  m_job;
+    int         m_top;
+    int         m_bottom;
+};
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Constructor
+**
+** @param[In] recipe        Lens, film and processing settings to apply
+** @param[In] pool          Optional pool to share the configured filters
+**                          with other engines
+**
+*/
+ClassicPrintEngine::ClassicPrintEngine(const ClassicPrintRecipe& recipe, FilterPool* pool) {
+    m_valid = false;
+
+    if (recipe.isValid() && pool) {
+        m_frame = recipe.processing()->frameFilter(*pool);
+    }
+    else if (recipe.isValid()) {
+        m_frame = QSharedPointer<const FrameFilter>(recipe.processing()->createFrameFilter());
+    }
+
+    if (recipe.isValid()) {
+        m_valid = m_frame &&
+                  recipe.lens()->addFilters(m_film, pool) &&
+                  recipe.film()->addFilters(m_film, pool) &&
+                  recipe.processing()->addFilters(m_processing, pool);
+
+        // Filters that would leave the photo as it is are dropped, and the
+        // rest of each stage is run over a row at a time. Only the lens and
+        // film may read the rows around each one, as the processing reads
+        // the film output of the row it is working on
+        m_film.optimise();
+        m_processing.optimise();
+        m_valid = m_valid && m_film.isRowPass() && (m_processing.contextRows() == 0);
+        if (m_frame && m_frame->isIdentity()) {
+            m_frame.clear();
+        }
+
+        // The processing key is empty if a "Random" light leak was not fixed
+        // by taking the recipe, as the output of that stage can not be kept
+        m_film_key = recipe.lens()->stageKey() + "|" + recipe.film()->stageKey();
+        m_processing_key = recipe.processing()->stageKey();
+    }
+
+    m_thread_pool = NULL;
+    m_buffer_pool = NULL;
+    m_stage_cache = NULL;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Destructor
+**
+*/
+ClassicPrintEngine::~ClassicPrintEngine() {
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Process a photo
+**
+** @param[In] photo         Photo to process. Must not be the same object
+**                          as processed
+** @param[out] processed    On return contains processed photo
+** @param[In] progress      Optional progress handler
+** @param[In] context       Context passed to the progress handler
+**
+** @return True/False
+*/
+bool ClassicPrintEngine::process(const QImage& photo, QImage& processed,
+                                 void (*progress)(int, void*), void* context) {
+    return processRegion(photo, QRect(), processed, progress, context);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Process part of a photo. The pixels are the same as those of
+**          the same part of the whole processed photo: the vignette is
+**          centred on the whole photo and the blur reads the pixels
+**          around the region. Only the region is rendered, and the
+**          stage cache is read but not added to
+**
+** @param[In] photo         Whole photo to process. Must not be the same
+**                          object as processed
+** @param[In] region        Part of the processed photo, frame included,
+**                          to render. A null rect renders all of it
+** @param[out] processed    On return contains the processed region,
+**                          clipped to the processed photo
+** @param[In] progress      Optional progress handler
+** @param[In] context       Context passed to the progress handler
+**
+** @return True/False. False if the region is outside the photo
+*/
+bool ClassicPrintEngine::processRegion(const QImage& photo, const QRect& region, QImage& processed,
+                                       void (*progress)(int, void*), void* context) {
+    if (!m_valid) {
+        return false;
+    }
+
+    // Start from the output of the last stage whose settings are unchanged
+    QImage  source;
+    QString film_key;
+    QString processing_key;
+    int     first_stage = STAGE_SOURCE;
+    if (m_stage_cache && !m_source_key.isEmpty()) {
+        film_key = m_source_key + "|" + m_film_key;
+        if (!m_processing_key.isEmpty()) {
+            processing_key = film_key + "|" + m_processing_key;
+        }
+        if (!processing_key.isEmpty() && m_stage_cache->find(processing_key, source)) {
+            first_stage = STAGE_PROCESSED;
+        }
+        else if (m_stage_cache->find(film_key, source)) {
+            first_stage = STAGE_FILM;
+        }
+    }
+
+    // Keep the output of the film stage if there is a cache for it
+    QImage  film;
+    if (first_stage == STAGE_SOURCE) {
+        if (photo.isNull()) {
+            return false;
+        }
+
+        // The row kernels work on 32-bit pixels. Alpha is only kept if the
+        // photo already had it
+        source = photo;
+        if ((source.format() != QImage::Format_RGB32) &&
+            (source.format() != QImage::Format_ARGB32)) {
+            source = source.convertToFormat(QImage::Format_RGB32);
+        }
+
+        // Not worth the copy if it is too large for the cache to keep. Only
+        // whole photos are kept
+        if (!film_key.isEmpty() && region.isNull() &&
+            ((qint64)source.bytesPerLine() * source.height() <= (qint64)m_stage_cache->limit() * 1024)) {
+            film = QImage(source.size(), source.format());
+        }
+    }
+
+    // The part of the framed photo to render
+    int     frame_width = this->frame_width(source.size());
+    QRect   framed(0, 0, source.width() + frame_width * 2, source.height() + frame_width * 2);
+    QRect   area = region.isNull() ? framed : region.intersected(framed);
+    if (area.isEmpty()) {
+        return false;
+    }
+
+    processed = QImage(area.size(), source.format());
+    if (processed.isNull()) {
+        return false;
+    }
+
+    ScanlineWindow  source_rows(source);
+
+    EngineJob   job;
+    job.engine = this;
+    job.source = &source_rows;
+    job.size = source.size();
+    job.frame_width = frame_width;
+    job.first_stage = first_stage;
+    if (first_stage == STAGE_SOURCE) {
+        job.film_states = m_film.prepareRows(job.size);
+    }
+    if (first_stage != STAGE_PROCESSED) {
+        job.processing_states = m_processing.prepareRows(job.size);
+    }
+    job.film_bits = film.isNull() ? NULL : film.bits();
+    job.film_bytes_per_line = film.bytesPerLine();
+    job.bits = processed.bits();
+    job.bytes_per_line = processed.bytesPerLine();
+    job.rows = processed.height();
+    job.top = area.top();
+    job.height = processed.height();
+    job.left = area.left();
+    job.right = area.left() + area.width();
+    job.framed_width = framed.width();
+    job.photo_left = qBound(0, job.left - frame_width, source.width());
+    job.photo_right = qBound(job.photo_left, job.right - frame_width, source.width());
+    job.progress = progress;
+    job.context = context;
+    job.rows_done = 0;
+
+    int     strip_height = 32;
+    if (m_thread_pool) {
+        // A few strips per worker so they finish at about the same time
+        strip_height = qMax(16, job.height / (m_thread_pool->maxThreadCount() * 4));
+    }
+    run_strips(job, job.top, job.top + job.height, strip_height);
+
+    if (m_cancel.isCancelled()) {
+        processed = QImage();
+        return false;
+    }
+
+    if (!film.isNull()) {
+        m_stage_cache->insert(film_key, film);
+    }
+    if (!processing_key.isEmpty() && region.isNull() && (first_stage != STAGE_PROCESSED)) {
+        m_stage_cache->insert(processing_key,
+                              processed.copy(frame_width, frame_width,
+                                             source.width(), source.height()));
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Process a photo read and written one scanline at a time. Only a
+**          band of rows of the photo is held in memory at once, so memory
+**          use grows with the width of the photo but not with its height
+**
+** @param[In] reader        Photo to process
+** @param[In] writer        Destination of the processed photo
+** @param[In] progress      Optional progress handler
+** @param[In] context       Context passed to the progress handler
+**
+** @return True/False
+*/
+bool ClassicPrintEngine::processStream(ScanlineReader& reader, ScanlineWriter& writer,
+                                       void (*progress)(int, void*), void* context) {
+    if (!m_valid) {
+        return false;
+    }
+    QSize   size = reader.size();
+    if (size.isEmpty()) {
+        return false;
+    }
+
+    int     frame_width = this->frame_width(size);
+    QSize   framed(size.width() + frame_width * 2, size.height() + frame_width * 2);
+    if (!writer.begin(framed)) {
+        return false;
+    }
+
+    // Output rows are rendered a band at a time, a few strips per worker
+    int     strip_height = 16;
+    int     band_height = strip_height;
+    if (m_thread_pool) {
+        band_height = strip_height * m_thread_pool->maxThreadCount() * 2;
+    }
+
+    // The source rows of a band plus the rows around them the blur reads.
+    // Rows are read into the window in order, overwriting the ones no band
+    // needs any more
+    int     context_rows = m_film.contextRows();
+    PooledImage window_buffer;
+    PooledImage band_buffer;
+    if (!window_buffer.create(m_buffer_pool,
+                              QSize(size.width(), qMin(size.height(), band_height + context_rows * 2)),
+                              QImage::Format_RGB32) ||
+        !band_buffer.create(m_buffer_pool, QSize(framed.width(), band_height),
+                            QImage::Format_RGB32)) {
+        return false;
+    }
+    QImage& window = window_buffer.image();
+    QImage& band = band_buffer.image();
+
+    ScanlineWindow  source_rows(window.bits(), window.bytesPerLine(), window.height(),
+                                size.width(), size.height());
+
+    EngineJob   job;
+    job.engine = this;
+    job.source = &source_rows;
+    job.size = size;
+    job.frame_width = frame_width;
+    job.first_stage = STAGE_SOURCE;
+    job.film_states = m_film.prepareRows(size);
+    job.processing_states = m_processing.prepareRows(size);
+    job.film_bits = NULL;
+    job.film_bytes_per_line = 0;
+    job.bits = band.bits();
+    job.bytes_per_line = band.bytesPerLine();
+    job.rows = band_height;
+    job.top = 0;
+    job.height = framed.height();
+    job.left = 0;
+    job.right = framed.width();
+    job.framed_width = framed.width();
+    job.photo_left = 0;
+    job.photo_right = size.width();
+    job.progress = progress;
+    job.context = context;
+    job.rows_done = 0;
+
+    int     next_row = 0;
+    for (int top = 0; top < framed.height(); top += band_height) {
+        if (m_cancel.isCancelled()) {
+            return false;
+        }
+        int     bottom = qMin(top + band_height, framed.height());
+
+        // Read up to the last source row this band needs
+        int     last_row = qMin(bottom - 1 - frame_width + context_rows, size.height() - 1);
+        for (; next_row <= last_row; next_row++) {
+            if (!reader.readRow((QRgb*)window.scanLine(next_row % window.height()))) {
+                return false;
+            }
+        }
+
+        run_strips(job, top, bottom, strip_height);
+        if (m_cancel.isCancelled()) {
+            return false;
+        }
+
+        for (int y = top; y < bottom; y++) {
+            if (!writer.writeRow((const QRgb*)band.constScanLine(y % band_height))) {
+                return false;
+            }
+        }
+    }
+
+    return writer.finish();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the thread pool used to render strips of the photo
+**
+** @param[In] pool          Thread pool, or NULL to render in the calling
+**                          thread. The output does not depend on the pool
+*/
+void ClassicPrintEngine::setThreadPool(QThreadPool* pool) {
+    m_thread_pool = pool;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the pool the buffers for intermediate images are taken from
+**
+** @param[In] pool          Buffer pool, or NULL to allocate them for every
+**                          photo
+*/
+void ClassicPrintEngine::setBufferPool(ImageBufferPool* pool) {
+    m_buffer_pool = pool;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the cache the output of each stage is kept in. process()
+**          starts from the output of the last stage whose settings are
+**          unchanged, and keeps the output of the stages it runs
+**
+** @param[In] cache         Stage cache, or NULL to run every stage
+** @param[In] source        Key of the photo passed to process(). Empty
+**                          runs every stage
+*/
+void ClassicPrintEngine::setStageCache(StageCache* cache, const QString& source) {
+    m_stage_cache = cache;
+    m_source_key = source;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the token checked between rows to abandon a render
+**
+** @param[In] cancel        Cancellation token. process() returns false
+**                          if it is cancelled before the photo is done
+*/
+void ClassicPrintEngine::setCancelToken(const CancelToken& cancel) {
+    m_cancel = cancel;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Render a range of output rows in strips, on the thread pool if
+**          there is one, and wait for them to finish
+**
+** @param[In] job           Photo and output rows to render
+** @param[In] top           First output row
+** @param[In] bottom        Output row after the last one
+** @param[In] strip_height  Rows per strip
+*/
+void ClassicPrintEngine::run_strips(EngineJob& job, int top, int bottom,
+                                    int strip_height) const {
+    int     strips = 0;
+    for (int y = top; y < bottom; y += strip_height) {
+        if (m_cancel.isCancelled()) {
+            break;
+        }
+        EngineStrip*    strip = new EngineStrip(&job, y, qMin(y + strip_height, bottom));
+        if (m_thread_pool) {
+            m_thread_pool->start(strip);
+        }
+        else {
+            strip->run();
+            delete strip;
+        }
+        strips++;
+    }
+    job.strips_done.acquire(strips);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the width of the frame around a photo
+**
+** @param[In] size          Size of the photo
+**
+** @return  Width in pixels, 0 if there is no frame
+*/
+int ClassicPrintEngine::frame_width(const QSize& size) const {
+    return m_frame ? m_frame->frame_width(size) : 0;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Render one scanline of the framed output image
+**
+** @param[In] job           Photo and the stage to start from
+** @param[In] y             Scanline of the output image
+** @param[out] row          Output scanline
+*/
+void ClassicPrintEngine::process_row(const EngineJob& job, int y, QRgb* row) const {
+    const ScanlineWindow&   source = *job.source;
+    int     frame_width = job.frame_width;
+    int     width = source.width();
+    int     src_y = y - frame_width;
+
+    // Rows above and below the photo are all frame
+    if ((src_y < 0) || (src_y >= source.height())) {
+        m_frame->process_frame_row(row, y, job.left, job.right);
+        return;
+    }
+
+    // Frame either side of the photo
+    if (m_frame) {
+        m_frame->process_frame_row(row, y, job.left, qMin(job.right, frame_width));
+        m_frame->process_frame_row(row, y, qMax(job.left, frame_width + width), job.right);
+    }
+
+    // And the photo itself, in the same order as the lens, film and processing.
+    // Pixels are addressed by their column in the whole photo, so the vignette
+    // and noise line up with the rest of it
+    int     left = job.photo_left;
+    int     right = job.photo_right;
+    if (left >= right) {
+        return;
+    }
+    QRgb*   photo_row = row + frame_width;
+    if (job.first_stage == STAGE_SOURCE) {
+        m_film.processRow(source, src_y, left, right, photo_row, job.film_states);
+        if (job.film_bits) {
+            memcpy(job.film_bits + src_y * job.film_bytes_per_line, photo_row, width * sizeof(QRgb));
+        }
+    }
+    else {
+        memcpy(photo_row + left, source.row(src_y) + left, (right - left) * sizeof(QRgb));
+    }
+    if (job.first_stage != STAGE_PROCESSED) {
+        m_processing.processRow(photo_row, src_y, left, right, job.size, job.processing_states);
+    }
+}
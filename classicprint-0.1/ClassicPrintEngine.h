@@ -0,0 +1,233 @@
+/*!
+** @file	ClassicPrintEngine.h
+**
+** @brief	Single pass renderer for the lens, film and processing effects
+**
+*/
+#ifndef __classicprintengine__h
+#define __classicprintengine__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QImage>
+#include <QSharedPointer>
+#include "FilterGraph.h"
+#include "CancelToken.h"
+#include "ScanlineWindow.h"
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+class ClassicPrintRecipe;
+class FrameFilter;
+class QThreadPool;
+class ImageBufferPool;
+class StageCache;
+class FilterPool;
+class EngineStrip;
+struct EngineJob;
+class ScanlineReader;
+class ScanlineWriter;
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Renders a photo through the whole effect chain in one traversal.
+**
+** The per-pixel stages of the lens, film and processing are evaluated one
+** scanline at a time, writing straight into the framed output image. This
+** replaces a full-image pass (and a deep copy and format conversion) per
+** filter with a single pass over the photo.
+*/
+class ClassicPrintEngine {
+public:
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Constructor
+    **
+    ** @param[In] recipe        Lens, film and processing settings to apply
+    ** @param[In] pool          Optional pool to share the configured filters
+    **                          with other engines
+    **
+    */
+    ClassicPrintEngine(const ClassicPrintRecipe& recipe, FilterPool* pool = NULL);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Destructor
+    **
+    */
+    ~ClassicPrintEngine();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Process a photo
+    **
+    ** @param[In] photo         Photo to process. Must not be the same object
+    **                          as processed
+    ** @param[out] processed    On return contains processed photo
+    ** @param[In] progress      Optional progress handler
+    ** @param[In] context       Context passed to the progress handler
+    **
+    ** @return True/False
+    */
+    bool    process(const QImage& photo, QImage& processed,
+                    void (*progress)(int, void*) = NULL, void* context = NULL);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Process part of a photo. The pixels are the same as those of
+    **          the same part of the whole processed photo: the vignette is
+    **          centred on the whole photo and the blur reads the pixels
+    **          around the region. Only the region is rendered, and the
+    **          stage cache is read but not added to
+    **
+    ** @param[In] photo         Whole photo to process. Must not be the same
+    **                          object as processed
+    ** @param[In] region        Part of the processed photo, frame included,
+    **                          to render. A null rect renders all of it
+    ** @param[out] processed    On return contains the processed region,
+    **                          clipped to the processed photo
+    ** @param[In] progress      Optional progress handler
+    ** @param[In] context       Context passed to the progress handler
+    **
+    ** @return True/False. False if the region is outside the photo
+    */
+    bool    processRegion(const QImage& photo, const QRect& region, QImage& processed,
+                          void (*progress)(int, void*) = NULL, void* context = NULL);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Process a photo read and written one scanline at a time. Only a
+    **          band of rows of the photo is held in memory at once, so memory
+    **          use grows with the width of the photo but not with its height
+    **
+    ** @param[In] reader        Photo to process
+    ** @param[In] writer        Destination of the processed photo
+    ** @param[In] progress      Optional progress handler
+    ** @param[In] context       Context passed to the progress handler
+    **
+    ** @return True/False
+    */
+    bool    processStream(ScanlineReader& reader, ScanlineWriter& writer,
+                          void (*progress)(int, void*) = NULL, void* context = NULL);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Set the thread pool used to render strips of the photo
+    **
+    ** @param[In] pool          Thread pool, or NULL to render in the calling
+    **                          thread. The output does not depend on the pool
+    */
+    void    setThreadPool(QThreadPool* pool);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Set the pool the buffers for intermediate images are taken from
+    **
+    ** @param[In] pool          Buffer pool, or NULL to allocate them for every
+    **                          photo
+    */
+    void    setBufferPool(ImageBufferPool* pool);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Set the cache the output of each stage is kept in. process()
+    **          starts from the output of the last stage whose settings are
+    **          unchanged, and keeps the output of the stages it runs
+    **
+    ** @param[In] cache         Stage cache, or NULL to run every stage
+    ** @param[In] source        Key of the photo passed to process(). Empty
+    **                          runs every stage
+    */
+    void    setStageCache(StageCache* cache, const QString& source);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Set the token checked between rows to abandon a render
+    **
+    ** @param[In] cancel        Cancellation token. process() returns false
+    **                          if it is cancelled before the photo is done
+    */
+    void    setCancelToken(const CancelToken& cancel);
+
+private:
+    friend class EngineStrip;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Render a range of output rows in strips, on the thread pool if
+    **          there is one, and wait for them to finish
+    **
+    ** @param[In] job           Photo and output rows to render
+    ** @param[In] top           First output row
+    ** @param[In] bottom        Output row after the last one
+    ** @param[In] strip_height  Rows per strip
+    */
+    void    run_strips(EngineJob& job, int top, int bottom, int strip_height) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the width of the frame around a photo
+    **
+    ** @param[In] size          Size of the photo
+    **
+    ** @return  Width in pixels, 0 if there is no frame
+    */
+    int     frame_width(const QSize& size) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Render the columns of one scanline of the framed output image
+    **          that the job asks for
+    **
+    ** @param[In] job           Photo, the stage to start from and the columns
+    ** @param[In] y             Scanline of the output image
+    ** @param[out] row          Output scanline, the whole width of the
+    **                          framed image
+    */
+    void    process_row(const EngineJob& job, int y, QRgb* row) const;
+
+private:
+    QThreadPool*        m_thread_pool;
+    ImageBufferPool*    m_buffer_pool;
+    CancelToken         m_cancel;
+
+    // Cached stage outputs, keyed by the photo and the settings of every
+    // stage up to and including the one cached
+    StageCache*         m_stage_cache;
+    QString             m_source_key;
+    QString             m_film_key;
+    QString             m_processing_key;
+
+    // False if a filter could not be made, or a stage can not be run a
+    // row at a time
+    bool                m_valid;
+
+    // The filters are only read while rendering, so they may be shared
+    // with other engines rendering at the same time
+
+    // Lens and film, then processing, with the filters that leave the photo
+    // as it is dropped and the channel lookups folded into tables. The lens
+    // blur reads the rows of the photo around each one
+    FilterGraph         m_film;
+    FilterGraph         m_processing;
+
+    // Frame, or NULL if there is none
+    QSharedPointer<const FrameFilter>      m_frame;
+};
+
+
+#endif
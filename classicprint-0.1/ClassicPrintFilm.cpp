@@ -11,6 +11,8 @@
 #include "ClassicPrintFilm.h"
 #include "NoiseFilter.h"
 #include "LevelsFilter.h"
+#include "FilterPool.h"
+#include "FilterGraph.h"
 #include "utils.h"
 
 #include <QtImageFilter>
@@ -70,35 +72,140 @@ ClassicPrintFilm::~ClassicPrintFilm() {
 ** @return  True/False
 */
 bool ClassicPrintFilm::process(QImage& image) {
-    QtImageFilter* filter;
+    FilterGraph graph;
+
+    emit progress(0);
+    if (!addFilters(graph, NULL) || !graph.run(image)) {
+        return false;
+    }
+    emit progress(100);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Create a levels filter that applies the colour temperature
+**
+** @return  Filter. The caller takes ownership of the object
+*/
+LevelsFilter* ClassicPrintFilm::createLevelsFilter() const {
+    return (LevelsFilter*)FilterPool::create("Levels", levelsOptions());
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Create a noise filter configured with the film grain
+**
+** @return  Filter. The caller takes ownership of the object
+*/
+NoiseFilter* ClassicPrintFilm::createNoiseFilter() const {
+    return (NoiseFilter*)FilterPool::create("Noise", noiseOptions());
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a levels filter that applies the colour temperature from
+**          a pool, so films with the same settings share one filter
+**
+** @param [In] pool     Pool to take the filter from
+**
+** @return  Filter or NULL if there is none
+*/
+QSharedPointer<const LevelsFilter> ClassicPrintFilm::levelsFilter(FilterPool& pool) const {
+    return pool.filter("Levels", levelsOptions()).staticCast<const LevelsFilter>();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a noise filter configured with the film grain from a pool
+**
+** @param [In] pool     Pool to take the filter from
+**
+** @return  Filter or NULL if there is none
+*/
+QSharedPointer<const NoiseFilter> ClassicPrintFilm::noiseFilter(FilterPool& pool) const {
+    return pool.filter("Noise", noiseOptions()).staticCast<const NoiseFilter>();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the options of the levels filter for the colour temperature
+**
+** @return  Options
+*/
+FilterOptions ClassicPrintFilm::levelsOptions() const {
 	QList<QVariant> levels;
 
     int green_level = (22 * m_temperature / 100) - 11;
     int blue_level = -((64 * m_temperature / 100) - 32);
 
-    emit progress(0);
-
     for (int i = 0; i < 256; ++i) {
 		levels.push_back(QVariant((qlonglong)qRgb(0,
 												  qBound(0, i + green_level, 255),
 												  qBound(0, i + blue_level, 255))));
     }
 
-    filter = QtImageFilterFactory::createImageFilter("Levels");
-	filter->setOption(QtImageFilter::FilterChannels, "gb");
-	filter->setOption(LevelsFilter::Levels, levels);
-    image = filter->apply(image);
+    FilterOptions   options;
+	options[QtImageFilter::FilterChannels] = QString("gb");
+	options[LevelsFilter::Levels] = levels;
+    return options;
+}
 
-    emit progress(66);
-    filter = QtImageFilterFactory::createImageFilter("Noise");
-    filter->setOption(NoiseFilter::NoisePercent, m_noise);
-    image = filter->apply(image);
-    delete filter;
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the options of the noise filter for the film grain
+**
+** @return  Options
+*/
+FilterOptions ClassicPrintFilm::noiseOptions() const {
+    FilterOptions   options;
+    options[NoiseFilter::NoisePercent] = m_noise;
+    return options;
+}
 
-    emit progress(100);
+//---------------------------------------------------------------------------
+/*!
+** @brief   Add the film filters to a graph, in the order they apply
+**
+** @param [In] graph    Graph to add the filters to
+** @param [In] pool     Pool to take the filters from, or NULL to make
+**                      new ones
+**
+** @return  True/False. False if a filter could not be made
+*/
+bool ClassicPrintFilm::addFilters(FilterGraph& graph, FilterPool* pool) const {
+    QSharedPointer<const QtImageFilter> levels;
+    QSharedPointer<const QtImageFilter> noise;
+    if (pool) {
+        levels = levelsFilter(*pool);
+        noise = noiseFilter(*pool);
+    }
+    else {
+        levels = QSharedPointer<const QtImageFilter>(createLevelsFilter());
+        noise = QSharedPointer<const QtImageFilter>(createNoiseFilter());
+    }
+    if (!levels || !noise) {
+        return false;
+    }
+
+    graph.append(levels);
+    graph.append(noise);
     return true;
 }
 
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a key for the settings that change the rendered film effect
+**
+** @return  Key. Equal keys render the same
+*/
+QString ClassicPrintFilm::stageKey() const {
+    return QString("film %1 %2")
+            .arg(m_temperature, 0, 'g', 17)
+            .arg(m_noise, 0, 'g', 17);
+}
+
 //---------------------------------------------------------------------------
 /*!
 ** @brief   Save configuration to a node
@@ -13,6 +13,8 @@
 #include <QImage>
 #include <QDomElement>
 #include <QObject>
+#include <QSharedPointer>
+#include "FilterPool.h"
 
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
@@ -21,6 +23,9 @@
 /*--------------------------------------------------------------------------- 
 ** Typedefs 
 */ 
+class LevelsFilter;
+class NoiseFilter;
+class FilterGraph;
  
 /*--------------------------------------------------------------------------- 
 ** Local function prototypes 
@@ -57,6 +62,63 @@ public:
     */
     bool    process(QImage& image);
 
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Create a levels filter that applies the colour temperature
+    **
+    ** @return  Filter. The caller takes ownership of the object
+    */
+    LevelsFilter* createLevelsFilter() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Create a noise filter configured with the film grain
+    **
+    ** @return  Filter. The caller takes ownership of the object
+    */
+    NoiseFilter* createNoiseFilter() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a levels filter that applies the colour temperature from
+    **          a pool, so films with the same settings share one filter
+    **
+    ** @param [In] pool     Pool to take the filter from
+    **
+    ** @return  Filter or NULL if there is none
+    */
+    QSharedPointer<const LevelsFilter> levelsFilter(FilterPool& pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a noise filter configured with the film grain from a pool
+    **
+    ** @param [In] pool     Pool to take the filter from
+    **
+    ** @return  Filter or NULL if there is none
+    */
+    QSharedPointer<const NoiseFilter> noiseFilter(FilterPool& pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Add the film filters to a graph, in the order they apply
+    **
+    ** @param [In] graph    Graph to add the filters to
+    ** @param [In] pool     Pool to take the filters from, or NULL to make
+    **                      new ones
+    **
+    ** @return  True/False. False if a filter could not be made
+    */
+    bool    addFilters(FilterGraph& graph, FilterPool* pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a key for the settings that change the rendered film effect
+    **
+    ** @return  Key. Equal keys render the same
+    */
+    QString stageKey() const;
+
     //---------------------------------------------------------------------------
     /*!
     ** @brief   Save configuration to a node
@@ -140,6 +202,13 @@ public:
 signals:
     void    progress(int percent);
 
+private:
+    // Options of the levels filter for the colour temperature
+    FilterOptions   levelsOptions() const;
+
+    // Options of the noise filter for the film grain
+    FilterOptions   noiseOptions() const;
+
 private:
     // Name of item
     QString     m_name;
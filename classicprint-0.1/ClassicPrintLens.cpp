@@ -14,6 +14,7 @@
 #include <QDomText>
 
 #include "VignetteFilter.h"
+#include "FilterGraph.h"
 
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
@@ -74,22 +75,96 @@ ClassicPrintLens::~ClassicPrintLens() {
 ** @return  True/False
 */
 bool ClassicPrintLens::process(QImage& image) {
-	VignetteFilter* filter = (VignetteFilter*)QtImageFilterFactory::createImageFilter("Vignette");
+	VignetteFilter* filter = createVignetteFilter();
     if (!filter) {
         return false;
     }
     emit progress(0);
-    filter->setOption(VignetteFilter::VignetteRadiusPercent, m_radius);
-    filter->setOption(VignetteFilter::VignetteAmountPercent, m_darkness);
-    filter->setOption(VignetteFilter::DodgePercent, m_dodge);
-    filter->setOption(VignetteFilter::Blur, m_defocus);
-	image = filter->apply(image, QRect(), on_progress, this);
+	filter->applyInPlace(image, QRect(), on_progress, this);
     delete filter;
     emit progress(100);
 
     return true;
 }
 
+//---------------------------------------------------------------------------
+/*!
+** @brief   Create a vignette filter configured with the lens settings
+**
+** @return  Filter. The caller takes ownership of the object
+*/
+VignetteFilter* ClassicPrintLens::createVignetteFilter() const {
+    return (VignetteFilter*)FilterPool::create("Vignette", vignetteOptions());
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a vignette filter configured with the lens settings from
+**          a pool, so lenses with the same settings share one filter
+**
+** @param [In] pool     Pool to take the filter from
+**
+** @return  Filter or NULL if there is none
+*/
+QSharedPointer<const VignetteFilter> ClassicPrintLens::vignetteFilter(FilterPool& pool) const {
+    return pool.filter("Vignette", vignetteOptions()).staticCast<const VignetteFilter>();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Add the lens filters to a graph, in the order they apply
+**
+** @param [In] graph    Graph to add the filters to
+** @param [In] pool     Pool to take the filters from, or NULL to make
+**                      new ones
+**
+** @return  True/False. False if a filter could not be made
+*/
+bool ClassicPrintLens::addFilters(FilterGraph& graph, FilterPool* pool) const {
+    QSharedPointer<const QtImageFilter> vignette;
+    if (pool) {
+        vignette = vignetteFilter(*pool);
+    }
+    else {
+        vignette = QSharedPointer<const QtImageFilter>(createVignetteFilter());
+    }
+    if (!vignette) {
+        return false;
+    }
+
+    graph.append(vignette);
+    return true;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the options of the vignette filter for the lens settings
+**
+** @return  Options
+*/
+FilterOptions ClassicPrintLens::vignetteOptions() const {
+    FilterOptions   options;
+    options[VignetteFilter::VignetteRadiusPercent] = m_radius;
+    options[VignetteFilter::VignetteAmountPercent] = m_darkness;
+    options[VignetteFilter::DodgePercent] = m_dodge;
+    options[VignetteFilter::Blur] = m_defocus;
+    return options;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a key for the settings that change the rendered lens effect
+**
+** @return  Key. Equal keys render the same
+*/
+QString ClassicPrintLens::stageKey() const {
+    return QString("lens %1 %2 %3 %4")
+            .arg(m_radius, 0, 'g', 17)
+            .arg(m_darkness, 0, 'g', 17)
+            .arg(m_dodge, 0, 'g', 17)
+            .arg(m_defocus ? 1 : 0);
+}
+
 //---------------------------------------------------------------------------
 /*!
 ** @brief   Save configuration to a node
@@ -13,6 +13,8 @@
 #include <QImage>
 #include <QDomElement>
 #include <QObject>
+#include <QSharedPointer>
+#include "FilterPool.h"
 
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
@@ -21,6 +23,8 @@
 /*--------------------------------------------------------------------------- 
 ** Typedefs 
 */ 
+class VignetteFilter;
+class FilterGraph;
  
 /*--------------------------------------------------------------------------- 
 ** Local function prototypes 
@@ -57,6 +61,45 @@ public:
     */
     bool    process(QImage& image);
 
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Create a vignette filter configured with the lens settings
+    **
+    ** @return  Filter. The caller takes ownership of the object
+    */
+    VignetteFilter* createVignetteFilter() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a vignette filter configured with the lens settings from
+    **          a pool, so lenses with the same settings share one filter
+    **
+    ** @param [In] pool     Pool to take the filter from
+    **
+    ** @return  Filter or NULL if there is none
+    */
+    QSharedPointer<const VignetteFilter> vignetteFilter(FilterPool& pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Add the lens filters to a graph, in the order they apply
+    **
+    ** @param [In] graph    Graph to add the filters to
+    ** @param [In] pool     Pool to take the filters from, or NULL to make
+    **                      new ones
+    **
+    ** @return  True/False. False if a filter could not be made
+    */
+    bool    addFilters(FilterGraph& graph, FilterPool* pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a key for the settings that change the rendered lens effect
+    **
+    ** @return  Key. Equal keys render the same
+    */
+    QString stageKey() const;
+
     //---------------------------------------------------------------------------
     /*!
     ** @brief   Save configuration to a node
@@ -183,6 +226,10 @@ public:
 signals:
     void    progress(int percent);
 
+private:
+    // Options of the vignette filter for the lens settings
+    FilterOptions   vignetteOptions() const;
+
 private:
     // Name of object
     QString     m_name;
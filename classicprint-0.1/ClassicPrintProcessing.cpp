@@ -15,14 +15,16 @@
 #include <QtImageFilterFactory>
 #include <QFileInfo>
 #include <QTime>
-#include <QDir>
 
 #include "ContrastFilter.h"
 #include "LevelsFilter.h"
 #include "BlendFilter.h"
 #include "FrameFilter.h"
+#include "FilterPool.h"
+#include "FilterGraph.h"
 
 #include "utils.h"
+#include "AssetCache.h"
 
 /*---------------------------------------------------------------------------
 ** Defines and Macros 
@@ -88,71 +90,299 @@ ClassicPrintProcessing::~ClassicPrintProcessing() {
 */
 bool ClassicPrintProcessing::process(QImage& image) {
     // Apply effects
-    QtImageFilter* filter;
+    FilterGraph graph;
 
     emit progress(0);
+    if (!addFilters(graph, NULL)) {
+        return false;
+    }
+    graph.append(createFrameFilter());
+    if (!graph.run(image)) {
+        return false;
+    }
+    emit progress(100);
+
+    return true;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Create a contrast filter configured with the processing contrast
+**
+** @return  Filter. The caller takes ownership of the object
+*/
+ContrastFilter* ClassicPrintProcessing::createContrastFilter() const {
+    return (ContrastFilter*)FilterPool::create("Contrast", contrastOptions());
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Create a levels filter that applies the colour profile
+**
+** @return  Filter. The caller takes ownership of the object
+*/
+LevelsFilter* ClassicPrintProcessing::createLevelsFilter() const {
+	return (LevelsFilter*)FilterPool::create("Levels", levelsOptions());
+}
 
-    filter = QtImageFilterFactory::createImageFilter("Contrast");
-    filter->setOption(ContrastFilter::ContrastPercent, m_contrast);
-    image = filter->apply(image);
-    delete filter;
-
-    emit progress(25);
-	/*
-    filter = QtImageFilterFactory::createImageFilter("ColourLookup");
-    filter->setOption(ColourLookupFilter::ColourLookupPercent, m_colourisation);
-    filter->setOption(ColourLookupFilter::ColourLookupFile, ClassicPrintSettings::colour_profile_dir() + "/colour_profile_1.png");
-    image = filter->apply(image);
-    delete filter;
-	*/
-	filter = QtImageFilterFactory::createImageFilter("Levels");
-	filter->setOption(LevelsFilter::Percent, m_colourisation_percent);
-	filter->setOption(QtImageFilter::FilterChannels, "rgb");
-	filter->setOption(LevelsFilter::Levels, m_cp->getColourProfile(m_colourisation));
-	image = filter->apply(image);
-	delete filter;
-
-    emit progress(50);
+//---------------------------------------------------------------------------
+/*!
+** @brief   Create a blend filter for the light leak. A recipe has its
+**          "Random" light leak fixed when it is snapshotted, otherwise a
+**          random leak is picked for every filter
+**
+** @return  Filter or NULL if no light leak is to be applied. The caller
+**          takes ownership of the object
+*/
+BlendFilter* ClassicPrintProcessing::createBlendFilter() const {
+	QString leak_name = lightLeakPath();
+	if (leak_name.isEmpty()) {
+		return NULL;
+	}
+	return (BlendFilter*)FilterPool::create("Blend", blendOptions(leak_name));
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the path of the light leak to apply. If the light leak is
+**          "Random" then a random leak is picked
+**
+** @return  Path or empty if no light leak is to be applied
+*/
+QString ClassicPrintProcessing::lightLeakPath() const {
 	// Apply the light leak if the leak file exists
-	// If it is set to "Random" then pick a random leak
-	QString light_leak(m_light_leak);
-	if (m_light_leak == RANDOM_LEAK) {
-		QDir leaks(":/classicPrintData/light_leak");
-		QStringList filter;
-		filter << "*.jpg" << "*.png";
-		QStringList files = leaks.entryList(filter);
+	QString light_leak = pickLightLeak(m_light_leak);
+	if (light_leak.size() > 0) {
+		QString leak_name = QString(LIGHT_LEAK_DIR) + "/" + light_leak;
+		QFileInfo fi(leak_name);
+		if ((m_light_leak.size() > 0) && fi.exists()) {
+			return leak_name;
+		}
+	}
+	return QString();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the light leak to apply for a setting. If it is "Random" then
+**          a random leak, or none, is picked
+**
+** @param [In] light_leak   Light leak setting
+**
+** @return  Light leak filename, or empty for none
+*/
+QString ClassicPrintProcessing::pickLightLeak(const QString& light_leak) {
+	if (light_leak == RANDOM_LEAK) {
+		QStringList files = lightLeaks();
 		// Get a random index into the list. Allow for 1 extra entry to signal
 		// no light leak
 		if (files.size() > 0) {
 			int index = qrand() % (files.size() + 1);
 			if (index < files.size()) {
-				light_leak = files[index];
-			}
-			else {
-				light_leak.clear();
+				return files[index];
 			}
+			return QString();
 		}
 	}
-	if (light_leak.size() > 0) {
-		QString leak_name = ":/classicPrintData/light_leak/" + light_leak;
-		QFileInfo fi(leak_name);
-		if ((m_light_leak.size() > 0) && fi.exists()) {
-			filter = QtImageFilterFactory::createImageFilter("Blend");
-			filter->setOption(BlendFilter::BlendImage, leak_name);
-			image = filter->apply(image);
-			delete filter;
-		}
+	return light_leak;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Replace a "Random" light leak with a leak picked at random, so
+**          every render with these settings applies the same one
+**
+*/
+void ClassicPrintProcessing::pickRandomLightLeak() {
+	m_light_leak = pickLightLeak(m_light_leak);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the light leak images available. The directory is only
+**          read the first time
+**
+** @return  File names of the light leaks
+*/
+QStringList ClassicPrintProcessing::lightLeaks() {
+	QStringList filter;
+	filter << "*.jpg" << "*.png";
+	return AssetCache::entryList(LIGHT_LEAK_DIR, filter);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Create a frame filter configured with the frame size
+**
+** @return  Filter. The caller takes ownership of the object
+*/
+FrameFilter* ClassicPrintProcessing::createFrameFilter() const {
+	return (FrameFilter*)FilterPool::create("Frame", frameOptions());
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a contrast filter configured with the processing contrast
+**          from a pool, so settings that are the same share one filter
+**
+** @param [In] pool     Pool to take the filter from
+**
+** @return  Filter or NULL if there is none
+*/
+QSharedPointer<const ContrastFilter> ClassicPrintProcessing::contrastFilter(FilterPool& pool) const {
+    return pool.filter("Contrast", contrastOptions()).staticCast<const ContrastFilter>();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a levels filter that applies the colour profile from a pool
+**
+** @param [In] pool     Pool to take the filter from
+**
+** @return  Filter or NULL if there is none
+*/
+QSharedPointer<const LevelsFilter> ClassicPrintProcessing::levelsFilter(FilterPool& pool) const {
+    return pool.filter("Levels", levelsOptions()).staticCast<const LevelsFilter>();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a blend filter for the light leak from a pool. A recipe
+**          has its "Random" light leak fixed when it is snapshotted,
+**          otherwise a random leak is picked for every filter
+**
+** @param [In] pool     Pool to take the filter from
+**
+** @return  Filter or NULL if no light leak is to be applied
+*/
+QSharedPointer<const BlendFilter> ClassicPrintProcessing::blendFilter(FilterPool& pool) const {
+	QString leak_name = lightLeakPath();
+	if (leak_name.isEmpty()) {
+		return QSharedPointer<const BlendFilter>();
 	}
-    emit progress(75);
-    filter = QtImageFilterFactory::createImageFilter("Frame");
-	filter->setOption(FrameFilter::FrameSizePercent, m_frame_size_percent);
-    image = filter->apply(image);
-    delete filter;
+    return pool.filter("Blend", blendOptions(leak_name)).staticCast<const BlendFilter>();
+}
 
-    emit progress(100);
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a frame filter configured with the frame size from a pool
+**
+** @param [In] pool     Pool to take the filter from
+**
+** @return  Filter or NULL if there is none
+*/
+QSharedPointer<const FrameFilter> ClassicPrintProcessing::frameFilter(FilterPool& pool) const {
+    return pool.filter("Frame", frameOptions()).staticCast<const FrameFilter>();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Add the processing filters to a graph, in the order they apply.
+**          The frame is not one of them, as it changes the size of the
+**          image
+**
+** @param [In] graph    Graph to add the filters to
+** @param [In] pool     Pool to take the filters from, or NULL to make
+**                      new ones
+**
+** @return  True/False. False if a filter could not be made
+*/
+bool ClassicPrintProcessing::addFilters(FilterGraph& graph, FilterPool* pool) const {
+    QSharedPointer<const QtImageFilter> contrast;
+    QSharedPointer<const QtImageFilter> levels;
+    QSharedPointer<const QtImageFilter> light_leak;
+    if (pool) {
+        contrast = contrastFilter(*pool);
+        levels = levelsFilter(*pool);
+        light_leak = blendFilter(*pool);
+    }
+    else {
+        contrast = QSharedPointer<const QtImageFilter>(createContrastFilter());
+        levels = QSharedPointer<const QtImageFilter>(createLevelsFilter());
+        light_leak = QSharedPointer<const QtImageFilter>(createBlendFilter());
+    }
+    if (!contrast || !levels) {
+        return false;
+    }
+
+    graph.append(contrast);
+    graph.append(levels);
+    graph.append(light_leak);
     return true;
 }
 
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the options of the contrast filter
+**
+** @return  Options
+*/
+FilterOptions ClassicPrintProcessing::contrastOptions() const {
+    FilterOptions   options;
+    options[ContrastFilter::ContrastPercent] = m_contrast;
+    return options;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the options of the levels filter for the colour profile
+**
+** @return  Options
+*/
+FilterOptions ClassicPrintProcessing::levelsOptions() const {
+    FilterOptions   options;
+	options[LevelsFilter::Percent] = m_colourisation_percent;
+	options[QtImageFilter::FilterChannels] = QString("rgb");
+	options[LevelsFilter::Levels] = m_cp->getColourProfile(m_colourisation);
+    return options;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the options of the blend filter for a light leak
+**
+** @param [In] leak_name    Path of the light leak image
+**
+** @return  Options
+*/
+FilterOptions ClassicPrintProcessing::blendOptions(const QString& leak_name) const {
+    FilterOptions   options;
+	options[BlendFilter::BlendImage] = leak_name;
+    return options;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the options of the frame filter
+**
+** @return  Options
+*/
+FilterOptions ClassicPrintProcessing::frameOptions() const {
+    FilterOptions   options;
+	options[FrameFilter::FrameSizePercent] = m_frame_size_percent;
+    return options;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a key for the contrast, colourisation and light leak
+**          settings. The frame is applied after the cached stages
+**
+** @return  Key. Equal keys render the same. Empty if the light leak is
+**          still "Random", which is only fixed when the recipe is
+**          snapshotted, as each render then picks its own leak
+*/
+QString ClassicPrintProcessing::stageKey() const {
+	if (m_light_leak == RANDOM_LEAK) {
+		return QString();
+	}
+	return QString("processing %1 %2 %3 %4")
+			.arg(m_contrast, 0, 'g', 17)
+			.arg(m_colourisation_percent, 0, 'g', 17)
+			.arg(m_colourisation)
+			.arg(m_light_leak);
+}
+
 //---------------------------------------------------------------------------
 /*!
 ** @brief   Save configuration to a node
@@ -14,16 +14,25 @@
 #include <QDomElement>
 #include <QObject>
 #include <QByteArray>
+#include <QStringList>
+#include <QSharedPointer>
+#include "FilterPool.h"
 
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
 */
 #define RANDOM_LEAK		"Random"
+#define LIGHT_LEAK_DIR	":/classicPrintData/light_leak"
 
 /*--------------------------------------------------------------------------- 
 ** Typedefs 
 */ 
 class ClassicPrint;
+class ContrastFilter;
+class LevelsFilter;
+class BlendFilter;
+class FrameFilter;
+class FilterGraph;
  
 /*--------------------------------------------------------------------------- 
 ** Local function prototypes 
@@ -60,6 +69,126 @@ public:
     */
     bool    process(QImage& image);
 
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Create a contrast filter configured with the processing contrast
+    **
+    ** @return  Filter. The caller takes ownership of the object
+    */
+    ContrastFilter* createContrastFilter() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Create a levels filter that applies the colour profile
+    **
+    ** @return  Filter. The caller takes ownership of the object
+    */
+    LevelsFilter* createLevelsFilter() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Create a blend filter for the light leak. A recipe has its
+    **          "Random" light leak fixed when it is snapshotted, otherwise a
+    **          random leak is picked for every filter
+    **
+    ** @return  Filter or NULL if no light leak is to be applied. The caller
+    **          takes ownership of the object
+    */
+    BlendFilter* createBlendFilter() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the light leak images available. The directory is only
+    **          read the first time
+    **
+    ** @return  File names of the light leaks
+    */
+    static QStringList lightLeaks();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Replace a "Random" light leak with a leak picked at random, so
+    **          every render with these settings applies the same one
+    **
+    */
+    void    pickRandomLightLeak();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Create a frame filter configured with the frame size
+    **
+    ** @return  Filter. The caller takes ownership of the object
+    */
+    FrameFilter* createFrameFilter() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a contrast filter configured with the processing contrast
+    **          from a pool, so settings that are the same share one filter
+    **
+    ** @param [In] pool     Pool to take the filter from
+    **
+    ** @return  Filter or NULL if there is none
+    */
+    QSharedPointer<const ContrastFilter> contrastFilter(FilterPool& pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a levels filter that applies the colour profile from a pool
+    **
+    ** @param [In] pool     Pool to take the filter from
+    **
+    ** @return  Filter or NULL if there is none
+    */
+    QSharedPointer<const LevelsFilter> levelsFilter(FilterPool& pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a blend filter for the light leak from a pool. A recipe
+    **          has its "Random" light leak fixed when it is snapshotted,
+    **          otherwise a random leak is picked for every filter
+    **
+    ** @param [In] pool     Pool to take the filter from
+    **
+    ** @return  Filter or NULL if no light leak is to be applied
+    */
+    QSharedPointer<const BlendFilter> blendFilter(FilterPool& pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a frame filter configured with the frame size from a pool
+    **
+    ** @param [In] pool     Pool to take the filter from
+    **
+    ** @return  Filter or NULL if there is none
+    */
+    QSharedPointer<const FrameFilter> frameFilter(FilterPool& pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Add the processing filters to a graph, in the order they apply.
+    **          The frame is not one of them, as it changes the size of
+    **          the image
+    **
+    ** @param [In] graph    Graph to add the filters to
+    ** @param [In] pool     Pool to take the filters from, or NULL to make
+    **                      new ones
+    **
+    ** @return  True/False. False if a filter could not be made
+    */
+    bool    addFilters(FilterGraph& graph, FilterPool* pool) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a key for the contrast, colourisation and light leak
+    **          settings. The frame is applied after the cached stages
+    **
+    ** @return  Key. Equal keys render the same. Empty if the light leak is
+    **          still "Random", which is only fixed when the recipe is
+    **          snapshotted, as each render then picks its own leak
+    */
+    QString stageKey() const;
+
     //---------------------------------------------------------------------------
     /*!
     ** @brief   Save configuration to a node
@@ -197,6 +326,20 @@ public:
 signals:
     void    progress(int percent);
 
+private:
+    // Options of the filters for the processing settings
+    FilterOptions   contrastOptions() const;
+    FilterOptions   levelsOptions() const;
+    FilterOptions   blendOptions(const QString& leak_name) const;
+    FilterOptions   frameOptions() const;
+
+    // Path of the light leak to apply, picking one if it is "Random", or
+    // empty if there is none
+    QString         lightLeakPath() const;
+
+    // Light leak filename for a setting, picking one if it is "Random"
+    static QString  pickLightLeak(const QString& light_leak);
+
 private:
     // Name of object
     QString     m_name;
@@ -0,0 +1,92 @@
+/*!
+** @file	ClassicPrintRecipe.cpp
+**
+** @brief	Snapshot of the lens, film and processing used for one render
+**
+*/
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include "ClassicPrintRecipe.h"
+#include "ClassicPrintLens.h"
+#include "ClassicPrintFilm.h"
+#include "ClassicPrintProcessing.h"
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Constructor for an empty recipe
+**
+*/
+ClassicPrintRecipe::ClassicPrintRecipe() {
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Constructor
+**
+** @param[In] lens          Lens settings. The recipe takes ownership
+** @param[In] film          Film settings. The recipe takes ownership
+** @param[In] processing    Processing settings. The recipe takes ownership
+**
+*/
+ClassicPrintRecipe::ClassicPrintRecipe(ClassicPrintLens* lens, ClassicPrintFilm* film,
+                                       ClassicPrintProcessing* processing)
+    : m_lens(lens), m_film(film), m_processing(processing) {
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   See if the recipe has settings to render with
+**
+** @return True/False
+*/
+bool ClassicPrintRecipe::isValid() const {
+    return !m_lens.isNull() && !m_film.isNull() && !m_processing.isNull();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the lens settings
+**
+** @return  Lens or NULL if the recipe is empty
+*/
+const ClassicPrintLens* ClassicPrintRecipe::lens() const {
+    return m_lens.data();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the film settings
+**
+** @return  Film or NULL if the recipe is empty
+*/
+const ClassicPrintFilm* ClassicPrintRecipe::film() const {
+    return m_film.data();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the processing settings
+**
+** @return  Processing or NULL if the recipe is empty
+*/
+const ClassicPrintProcessing* ClassicPrintRecipe::processing() const {
+    return m_processing.data();
+}
@@ -0,0 +1,103 @@
+/*!
+** @file	ClassicPrintRecipe.h
+**
+** @brief	Snapshot of the lens, film and processing used for one render
+**
+*/
+#ifndef __classicprintrecipe__h
+#define __classicprintrecipe__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QSharedPointer>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+class ClassicPrintLens;
+class ClassicPrintFilm;
+class ClassicPrintProcessing;
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Immutable copy of the settings for one render.
+**
+** A recipe owns private copies of the lens, film and processing it was
+** made from, so later changes to the live settings do not affect a render
+** that is already running. Copies of a recipe share the same snapshot and
+** are cheap to pass between threads.
+*/
+class ClassicPrintRecipe {
+public:
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Constructor for an empty recipe
+    **
+    */
+    ClassicPrintRecipe();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Constructor
+    **
+    ** @param[In] lens          Lens settings. The recipe takes ownership
+    ** @param[In] film          Film settings. The recipe takes ownership
+    ** @param[In] processing    Processing settings. The recipe takes ownership
+    **
+    */
+    ClassicPrintRecipe(ClassicPrintLens* lens, ClassicPrintFilm* film,
+                       ClassicPrintProcessing* processing);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   See if the recipe has settings to render with
+    **
+    ** @return True/False
+    */
+    bool    isValid() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the lens settings
+    **
+    ** @return  Lens or NULL if the recipe is empty
+    */
+    const ClassicPrintLens*         lens() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the film settings
+    **
+    ** @return  Film or NULL if the recipe is empty
+    */
+    const ClassicPrintFilm*         film() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the processing settings
+    **
+    ** @return  Processing or NULL if the recipe is empty
+    */
+    const ClassicPrintProcessing*   processing() const;
+
+private:
+    QSharedPointer<const ClassicPrintLens>          m_lens;
+    QSharedPointer<const ClassicPrintFilm>          m_film;
+    QSharedPointer<const ClassicPrintProcessing>    m_processing;
+};
+
+
+#endif
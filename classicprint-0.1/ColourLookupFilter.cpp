@@ -9,7 +9,9 @@
 ** Includes 
 */
 #include "ColourLookupFilter.h"
+#include "PointwiseLut.h"
 #include "utils.h"
+#include "AssetCache.h"
 
 #if 1
 #include <QDomDocument>
@@ -46,8 +48,16 @@ ColourLookupFilter::ColourLookupFilter() {
 QImage ColourLookupFilter::apply(
 	const QImage &img,
  	const QRect& clipRect
-        ) const {
-    int x;
+) const {
+	QImage resultImg = img;
+	applyInPlace(resultImg, clipRect);
+	return resultImg;
+}
+
+bool ColourLookupFilter::applyInPlace(
+	QImage &img,
+ 	const QRect& clipRect
+) const {
     int y;
     int top = 0;
     int bottom = img.height();
@@ -58,16 +68,19 @@ QImage ColourLookupFilter::apply(
         // If we have a cliprect, set our coordinates to our cliprect
         // and make sure it is within the boundaries of the image
         top = qMax(top, clipRect.top());
-        bottom = qMin(bottom, clipRect.bottom());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
         left = qMax(left, clipRect.left());
-        right = qMin(right, clipRect.right());
+        right = qMin(right, clipRect.right() + 1);
     }
 
     QImage::Format fmt = img.format();
-    QImage resultImg = img.convertToFormat(QImage::Format_ARGB32);
+    if ((fmt != QImage::Format_RGB32) && (fmt != QImage::Format_ARGB32)) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    }
 
 #if 0
 	{
+		int x;
 		QDomDocument    doc("ColourLevels");
 		// Create the root element
 		QDomElement     root = doc.createElement("ColourLevels");
@@ -127,24 +140,75 @@ QImage ColourLookupFilter::apply(
 	}
 #endif
 
+    PointwiseLut lut;
+    lut.append(*this);
+
     for (y = top; y < bottom; y++) {
-        for (x = left; x < right; x++) {
-            QRgb rgb = resultImg.pixel(x, y);
-            int red = qRed(m_colour_lookup_image.pixel(qRed(rgb), 0 + 3 * m_colour_lookup_index));
-            int green = qGreen(m_colour_lookup_image.pixel(qGreen(rgb), 1 + 3 * m_colour_lookup_index));
-            int blue = qBlue(m_colour_lookup_image.pixel(qBlue(rgb), 2 + 3 * m_colour_lookup_index));
-			red = merge_colours(red, qRed(rgb), (int)m_colour_lookup_percent, 100);
-			green = merge_colours(green, qGreen(rgb), (int)m_colour_lookup_percent, 100);
-			blue = merge_colours(blue, qBlue(rgb), (int)m_colour_lookup_percent, 100);
-
-            resultImg.setPixel(x, y, qRgb(red, green, blue));
-        }
+        lut.process_row((QRgb*)img.scanLine(y), left, right);
     }
-    
-    if (resultImg.format() != fmt) {
-        resultImg = resultImg.convertToFormat(fmt);
+
+    if (img.format() != fmt) {
+        img = img.convertToFormat(fmt);
     }
-    return resultImg;
+    return true;
+}
+
+void ColourLookupFilter::process_row(
+	QRgb* row,
+	int left,
+	int right
+) const {
+	// The red, green and blue tables are consecutive rows of the lookup image
+	int lookup_row = 3 * m_colour_lookup_index;
+	if ((lookup_row < 0) || (lookup_row + 2 >= m_colour_lookup_image.height()) ||
+		(m_colour_lookup_image.width() < 256)) {
+		return;
+	}
+	const QRgb* red_lookup = (const QRgb*)m_colour_lookup_image.scanLine(lookup_row);
+	const QRgb* green_lookup = (const QRgb*)m_colour_lookup_image.scanLine(lookup_row + 1);
+	const QRgb* blue_lookup = (const QRgb*)m_colour_lookup_image.scanLine(lookup_row + 2);
+
+	for (int x = left; x < right; x++) {
+		QRgb rgb = row[x];
+		int red = qRed(red_lookup[qRed(rgb)]);
+		int green = qGreen(green_lookup[qGreen(rgb)]);
+		int blue = qBlue(blue_lookup[qBlue(rgb)]);
+		red = merge_colours(red, qRed(rgb), (int)m_colour_lookup_percent, 100);
+		green = merge_colours(green, qGreen(rgb), (int)m_colour_lookup_percent, 100);
+		blue = merge_colours(blue, qBlue(rgb), (int)m_colour_lookup_percent, 100);
+
+		row[x] = qRgb(red, green, blue);
+	}
+}
+
+QtImageFilter::FilterKind
+ColourLookupFilter::kind(
+) const {
+	return ChannelLookupFilter;
+}
+
+void
+ColourLookupFilter::processRow(
+	QRgb* row,
+	int y,
+	int left,
+	int right,
+	const QSize& size,
+	const QtImageFilterRowState* state
+) const {
+	Q_UNUSED(y);
+	Q_UNUSED(size);
+	Q_UNUSED(state);
+	process_row(row, left, right);
+}
+
+bool
+ColourLookupFilter::isIdentity(
+) const {
+	int lookup_row = 3 * m_colour_lookup_index;
+	return ((int)m_colour_lookup_percent == 0) ||
+		   (lookup_row < 0) || (lookup_row + 2 >= m_colour_lookup_image.height()) ||
+		   (m_colour_lookup_image.width() < 256);
 }
 
 QString
@@ -179,7 +243,8 @@ ColourLookupFilter::setOption(
     }
     else if (filteroption == ColourLookupFile) {
         m_colour_lookup_file = value.toString();
-        m_colour_lookup_image.load(m_colour_lookup_file);
+        // Rows are read directly as 32-bit lookup tables
+        m_colour_lookup_image = AssetCache::image(m_colour_lookup_file);
     }
     else if (filteroption == ColourLookupIndex) {
         m_colour_lookup_index = value.toInt();
@@ -9,6 +9,7 @@
 ** Includes 
 */
 #include "ContrastFilter.h"
+#include "PointwiseLut.h"
 #include "utils.h"
 #include <stdint.h>
 
@@ -40,8 +41,16 @@ ContrastFilter::ContrastFilter() {
 QImage ContrastFilter::apply(
 	const QImage &img,
  	const QRect& clipRect
-        ) const {
-    int x;
+) const {
+	QImage resultImg = img;
+	applyInPlace(resultImg, clipRect);
+	return resultImg;
+}
+
+bool ContrastFilter::applyInPlace(
+	QImage &img,
+ 	const QRect& clipRect
+) const {
     int y;
     int top = 0;
     int bottom = img.height();
@@ -52,43 +61,81 @@ QImage ContrastFilter::apply(
         // If we have a cliprect, set our coordinates to our cliprect
         // and make sure it is within the boundaries of the image
         top = qMax(top, clipRect.top());
-        bottom = qMin(bottom, clipRect.bottom());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
         left = qMax(left, clipRect.left());
-        right = qMin(right, clipRect.right());
+        right = qMin(right, clipRect.right() + 1);
     }
 
     QImage::Format fmt = img.format();
-    QImage resultImg = img.convertToFormat(QImage::Format_ARGB32);
+    if ((fmt != QImage::Format_RGB32) && (fmt != QImage::Format_ARGB32)) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    }
 
-	uchar* bits = resultImg.bits();
+    // Every channel is a function of its own value, so one table does it
+    PointwiseLut lut;
+    lut.append(*this);
 
     for (y = top; y < bottom; y++) {
-        for (x = left; x < right; x++) {
-			// Read the pixel data
-			QRgb rgb = ((uint32_t*)bits)[x];
-
-			int red = qRed(rgb) < 128 ?
-						 (2 * scale(qRed(rgb), 0, 255, 64, 192) * qRed(rgb) / 255) :
-						 255 - (2 * (255 - scale(qRed(rgb), 0, 255, 64, 192)) * (255 - qRed(rgb)) / 255);
-			red = merge_colours(red, qRed(rgb), (int)m_contrast_percent, 100);
-			int green = qGreen(rgb) < 128 ?
-						 (2 * scale(qGreen(rgb), 0, 255, 64, 192) * qGreen(rgb) / 255) :
-						 255 - (2 * (255 - scale(qGreen(rgb), 0, 255, 64, 192)) * (255 - qGreen(rgb)) / 255);
-			green = merge_colours(green, qGreen(rgb), (int)m_contrast_percent, 100);
-			int blue = qBlue(rgb) < 128 ?
-						 (2 * scale(qBlue(rgb), 0, 255, 64, 192) * qBlue(rgb) / 255) :
-						 255 - (2 * (255 - scale(qBlue(rgb), 0, 255, 64, 192)) * (255 - qBlue(rgb)) / 255);
-			blue = merge_colours(blue, qBlue(rgb), (int)m_contrast_percent, 100);
-
-			((uint32_t*)bits)[x] = qRgb(red, green, blue);
-		}
-		bits += resultImg.bytesPerLine();
+		lut.process_row((QRgb*)img.scanLine(y), left, right);
 	}
-    
-    if (resultImg.format() != fmt) {
-        resultImg = resultImg.convertToFormat(fmt);
+
+    if (img.format() != fmt) {
+        img = img.convertToFormat(fmt);
     }
-    return resultImg;
+    return true;
+}
+
+void ContrastFilter::process_row(
+	QRgb* row,
+	int left,
+	int right
+) const {
+	for (int x = left; x < right; x++) {
+		// Read the pixel data
+		QRgb rgb = row[x];
+
+		int red = qRed(rgb) < 128 ?
+					 (2 * scale(qRed(rgb), 0, 255, 64, 192) * qRed(rgb) / 255) :
+					 255 - (2 * (255 - scale(qRed(rgb), 0, 255, 64, 192)) * (255 - qRed(rgb)) / 255);
+		red = merge_colours(red, qRed(rgb), (int)m_contrast_percent, 100);
+		int green = qGreen(rgb) < 128 ?
+					 (2 * scale(qGreen(rgb), 0, 255, 64, 192) * qGreen(rgb) / 255) :
+					 255 - (2 * (255 - scale(qGreen(rgb), 0, 255, 64, 192)) * (255 - qGreen(rgb)) / 255);
+		green = merge_colours(green, qGreen(rgb), (int)m_contrast_percent, 100);
+		int blue = qBlue(rgb) < 128 ?
+					 (2 * scale(qBlue(rgb), 0, 255, 64, 192) * qBlue(rgb) / 255) :
+					 255 - (2 * (255 - scale(qBlue(rgb), 0, 255, 64, 192)) * (255 - qBlue(rgb)) / 255);
+		blue = merge_colours(blue, qBlue(rgb), (int)m_contrast_percent, 100);
+
+		row[x] = qRgb(red, green, blue);
+	}
+}
+
+QtImageFilter::FilterKind
+ContrastFilter::kind(
+) const {
+	return ChannelLookupFilter;
+}
+
+void
+ContrastFilter::processRow(
+	QRgb* row,
+	int y,
+	int left,
+	int right,
+	const QSize& size,
+	const QtImageFilterRowState* state
+) const {
+	Q_UNUSED(y);
+	Q_UNUSED(size);
+	Q_UNUSED(state);
+	process_row(row, left, right);
+}
+
+bool
+ContrastFilter::isIdentity(
+) const {
+	return (int)m_contrast_percent == 0;
 }
 
 QString
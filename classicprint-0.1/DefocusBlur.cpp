@@ -0,0 +1,122 @@
+/*! 
+** @file	DefocusBlur.cpp
+** 
+** @brief	Separable blur used for the defocused lens perimeter
+**  
+*/  
+ 
+/*--------------------------------------------------------------------------- 
+** Includes 
+*/
+#include "DefocusBlur.h"
+#include <QVarLengthArray>
+ 
+/*--------------------------------------------------------------------------- 
+** Defines and Macros 
+*/
+ 
+/*--------------------------------------------------------------------------- 
+** Typedefs 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Local function prototypes 
+*/ 
+static int mirror(int i, int size);
+ 
+/*--------------------------------------------------------------------------- 
+** Data 
+*/
+
+// Map a coordinate outside [0, size) back into the image, matching the
+// border handling of convolvePixel()
+static int
+mirror(int i, int size) {
+	if (i < 0) {
+		return -i % size;
+	}
+	if (i >= size) {
+		return size - 1 - i % size;
+	}
+	return i;
+}
+
+void
+defocus_row(const ScanlineWindow &img, int y, int radius, int left, int right, QRgb* out) {
+	int width = img.width();
+	int height = img.height();
+	if ((left >= right) || (radius < 1)) {
+		return;
+	}
+
+	// Source rows covered by the kernel, with the edges mirrored
+	int taps = 2 * radius + 1;
+	QVarLengthArray<const QRgb*, 16> rows(taps);
+	for (int i = 0; i < taps; ++i) {
+		rows[i] = img.row(mirror(y - radius + i, height));
+	}
+
+	// Vertical pass over every column the horizontal window touches. Only
+	// the first and last radius columns can fall outside the image
+	int first = left - radius;
+	int columns = right - left + 2 * radius;
+	QVarLengthArray<int, 3 * 1024> sums(3 * columns);
+	int* sum = sums.data();
+	for (int i = 0; i < columns; ++i, sum += 3) {
+		int x = first + i;
+		if ((x < 0) || (x >= width)) {
+			x = mirror(x, width);
+		}
+		if (radius == 1) {
+			QRgb above = rows[0][x];
+			QRgb centre = rows[1][x];
+			QRgb below = rows[2][x];
+			sum[0] = qRed(above) + 2 * qRed(centre) + qRed(below);
+			sum[1] = qGreen(above) + 2 * qGreen(centre) + qGreen(below);
+			sum[2] = qBlue(above) + 2 * qBlue(centre) + qBlue(below);
+		}
+		else {
+			sum[0] = 0;
+			sum[1] = 0;
+			sum[2] = 0;
+			for (int j = 0; j < taps; ++j) {
+				QRgb rgb = rows[j][x];
+				sum[0] += qRed(rgb);
+				sum[1] += qGreen(rgb);
+				sum[2] += qBlue(rgb);
+			}
+		}
+	}
+
+	// Horizontal pass
+	sum = sums.data();
+	if (radius == 1) {
+		// [1, 2, 1] x [1, 2, 1] has 4 in the centre where the kernel has 2
+		const QRgb* centre = rows[1];
+		for (int x = left; x < right; ++x, sum += 3) {
+			int red = (sum[0] + 2 * sum[3] + sum[6] - 2 * qRed(centre[x])) / 14;
+			int green = (sum[1] + 2 * sum[4] + sum[7] - 2 * qGreen(centre[x])) / 14;
+			int blue = (sum[2] + 2 * sum[5] + sum[8] - 2 * qBlue(centre[x])) / 14;
+			*out++ = qRgb(red, green, blue);
+		}
+	}
+	else {
+		int area = taps * taps;
+		int red = 0;
+		int green = 0;
+		int blue = 0;
+		for (int i = 0; i < taps; ++i) {
+			red += sum[3 * i];
+			green += sum[3 * i + 1];
+			blue += sum[3 * i + 2];
+		}
+		for (int x = left; x < right; ++x, sum += 3) {
+			*out++ = qRgb(red / area, green / area, blue / area);
+			if (x + 1 < right) {
+				red += sum[3 * taps] - sum[0];
+				green += sum[3 * taps + 1] - sum[1];
+				blue += sum[3 * taps + 2] - sum[2];
+			}
+		}
+	}
+}
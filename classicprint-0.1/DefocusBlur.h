@@ -0,0 +1,45 @@
+/*!
+** @file	DefocusBlur.h
+** 
+** @brief	Separable blur used for the defocused lens perimeter
+**  
+*/  
+#ifndef __defocusblur__h
+#define __defocusblur__h
+ 
+/*--------------------------------------------------------------------------- 
+** Includes 
+*/
+#include <QRgb>
+#include "ScanlineWindow.h"
+ 
+/*--------------------------------------------------------------------------- 
+** Defines and Macros 
+*/
+ 
+/*--------------------------------------------------------------------------- 
+** Typedefs 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Local function prototypes 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Data 
+*/
+
+// Blur pixels [left, right) of scanline y of img into out, where out[0] is
+// the blurred value of pixel left. Scanlines y - radius to y + radius of img
+// must be available.
+//
+// A radius of 1 gives exactly the 3x3 { 1, 2, 1, 2, 2, 2, 1, 2, 1 } / 14
+// kernel the vignette has always used, computed as the separable
+// [1, 2, 1] x [1, 2, 1] kernel less twice the centre pixel. Larger radii are
+// a (2 * radius + 1) square box blur with a sliding window along the row, so
+// the cost per pixel grows linearly with the radius rather than with its
+// square. Edges are mirrored the same way as convolvePixel().
+void
+defocus_row(const ScanlineWindow &img, int y, int radius, int left, int right, QRgb* out);
+
+#endif
@@ -0,0 +1,397 @@
+/*!
+** @file	FilterGraph.cpp
+**
+** @brief	Chain of image filters, optimised and scheduled by their kind
+**
+*/
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include "FilterGraph.h"
+
+#include <QVarLengthArray>
+
+#include <string.h>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Constructor for an empty graph
+**
+*/
+FilterGraph::FilterGraph() {
+    m_optimised = false;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Destructor
+**
+*/
+FilterGraph::~FilterGraph() {
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Add a filter after the ones already in the graph
+**
+** @param[In] filter        Filter. The graph takes ownership of it. NULL
+**                          is ignored, so optional filters can be added
+**                          as they are created
+*/
+void FilterGraph::append(QtImageFilter* filter) {
+    append(QSharedPointer<const QtImageFilter>(filter));
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Add a filter shared with other users after the ones already
+**          in the graph. It is only read, never changed
+**
+** @param[In] filter        Filter. NULL is ignored
+*/
+void FilterGraph::append(const QSharedPointer<const QtImageFilter>& filter) {
+    if (filter) {
+        m_filters.append(filter);
+        m_optimised = false;
+    }
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Plan the passes over the image from the filters and their
+**          current options. Must be called after the last filter is
+**          added, and again if their options change
+**
+*/
+void FilterGraph::optimise() {
+    m_passes.clear();
+
+    FilterPass  rows;
+    for (int i = 0; i < m_filters.size(); i++) {
+        const QSharedPointer<const QtImageFilter>&  filter = m_filters.at(i);
+        if (filter->isIdentity()) {
+            continue;
+        }
+
+        switch (filter->kind()) {
+        case QtImageFilter::ChannelLookupFilter:
+            // Fold into the table of the previous step if it is one
+            if (rows.steps.isEmpty() || !rows.steps.last().lut) {
+                FilterStep  step;
+                step.lut = QSharedPointer<PointwiseLut>(new PointwiseLut);
+                rows.steps.append(step);
+            }
+            rows.steps.last().lut->append(*filter);
+            break;
+
+        case QtImageFilter::PointwiseFilter: {
+            FilterStep  step;
+            step.filter = filter;
+            rows.steps.append(step);
+            break;
+        }
+
+        default: {
+            // Finish the row pass before it
+            if (!rows.steps.isEmpty()) {
+                m_passes.append(rows);
+                rows = FilterPass();
+            }
+
+            // A neighbourhood filter that can be applied a range of rows
+            // at a time starts the next row pass, reading the rows around
+            // each one from the output of the pass before
+            if ((filter->kind() == QtImageFilter::NeighbourhoodFilter) &&
+                (filter->contextRows() >= 0)) {
+                FilterStep  step;
+                step.filter = filter;
+                rows.steps.append(step);
+                rows.neighbourhood = true;
+                rows.context = filter->contextRows();
+                break;
+            }
+
+            // Otherwise the filter is applied to the whole image
+            FilterPass  whole;
+            whole.filter = filter;
+            m_passes.append(whole);
+            break;
+        }
+        }
+    }
+    if (!rows.steps.isEmpty()) {
+        m_passes.append(rows);
+    }
+
+    m_optimised = true;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the number of passes over the image once optimised
+**
+** @return  Number of passes
+*/
+int FilterGraph::passes() const {
+    return m_passes.size();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Check if the optimised graph can be run a row at a time with
+**          processRow(). True if every filter left is a channel lookup
+**          or pointwise filter, apart from a first one that can be
+**          applied a range of rows at a time, including if there are
+**          none
+**
+** @return  True/False
+*/
+bool FilterGraph::isRowPass() const {
+    return m_passes.isEmpty() ||
+           ((m_passes.size() == 1) && !m_passes.first().filter);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the number of input scanlines either side of a row that
+**          processRow() reads
+**
+** @return  Number of scanlines, -1 if the graph is not one row pass
+*/
+int FilterGraph::contextRows() const {
+    if (!isRowPass()) {
+        return -1;
+    }
+    if (m_passes.isEmpty() || !m_passes.first().neighbourhood) {
+        return 0;
+    }
+    return m_passes.first().context;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Prepare the row pass for an image
+**
+** @param[In] size          Size of the image
+**
+** @return  State of the steps, to pass to processRow()
+*/
+FilterGraph::RowStates FilterGraph::prepareRows(const QSize& size) const {
+    if (m_passes.isEmpty()) {
+        return RowStates();
+    }
+    return prepare_pass(m_passes.first(), size);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Run the row pass over pixels [left, right) of one scanline.
+**          Only for graphs where isRowPass() is true. Rows may be
+**          processed in any order and from several threads at once
+**
+** @param[In] input         Input image, holding the contextRows()
+**                          scanlines either side of y
+** @param[In] y             Scanline of the image
+** @param[In] left          First pixel
+** @param[In] right         Pixel after the last one
+** @param[out] row          Output scanline, each pixel at its column in
+**                          the image. May be the input scanline if
+**                          contextRows() is 0
+** @param[In] states        What prepareRows() returned for the image
+*/
+void FilterGraph::processRow(const QtScanlineWindow& input, int y, int left, int right, QRgb* row,
+                             const RowStates& states) const {
+    if (!m_passes.isEmpty()) {
+        process_pass_row(m_passes.first(), input, y, left, right, row, states);
+    }
+    else if (input.row(y) != row) {
+        memcpy(row + left, input.row(y) + left, (right - left) * sizeof(QRgb));
+    }
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Run the row pass over pixels [left, right) of one scanline in
+**          place. Only for graphs where contextRows() is 0
+**
+** @param[In,out] row       Scanline, each pixel at its column in the
+**                          image
+** @param[In] y             Scanline of the image
+** @param[In] left          First pixel
+** @param[In] right         Pixel after the last one
+** @param[In] size          Size of the image
+** @param[In] states        What prepareRows() returned for the image
+*/
+void FilterGraph::processRow(QRgb* row, int y, int left, int right, const QSize& size,
+                             const RowStates& states) const {
+    if (m_passes.isEmpty()) {
+        return;
+    }
+
+    const FilterPass&   pass = m_passes.first();
+    if (pass.neighbourhood) {
+        // The first filter may read the pixels either side of the ones it
+        // writes, so it reads a copy of the row
+        QVarLengthArray<QRgb, 1024> line(size.width());
+        memcpy(line.data(), row, size.width() * sizeof(QRgb));
+        process_pass_row(pass, QtScanlineWindow((const uchar*)line.constData(), 0, 1,
+                                                size.width(), size.height()),
+                         y, left, right, row, states);
+    }
+    else {
+        process_pass_row(pass, QtScanlineWindow((const uchar*)row, 0, 1,
+                                                size.width(), size.height()),
+                         y, left, right, row, states);
+    }
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Apply the filters to a whole image, optimising the graph first
+**          if it has not been since the last filter was added
+**
+** @param[In,out] image     Image to filter in place
+** @param[In] progress      Optional progress handler, called after each
+**                          pass
+** @param[In] context       Context passed to the progress handler
+**
+** @return True/False
+*/
+bool FilterGraph::run(QImage& image, void (*progress)(int, void*), void* context) {
+    if (image.isNull()) {
+        return false;
+    }
+    if (!m_optimised) {
+        optimise();
+    }
+
+    for (int i = 0; i < m_passes.size(); i++) {
+        const FilterPass&   pass = m_passes.at(i);
+        if (pass.filter) {
+            if (!pass.filter->applyInPlace(image)) {
+                return false;
+            }
+        }
+        else {
+            // The row kernels work on 32-bit pixels
+            if ((image.format() != QImage::Format_RGB32) &&
+                (image.format() != QImage::Format_ARGB32)) {
+                image = image.convertToFormat(QImage::Format_RGB32);
+                if (image.isNull()) {
+                    return false;
+                }
+            }
+
+            // Detach before taking a view of the pixels
+            image.bits();
+
+            QSize       size = image.size();
+            RowStates   states = prepare_pass(pass, size);
+
+            // The first filter of a neighbourhood pass reads the rows around
+            // each one as they were before the pass. Keep copies of those in
+            // a ring, read ahead of the rows being overwritten
+            QImage      original;
+            if (pass.neighbourhood) {
+                original = QImage(size.width(), qMin(size.height(), pass.context * 2 + 1),
+                                  image.format());
+                if (original.isNull()) {
+                    return false;
+                }
+            }
+            QtScanlineWindow    input = original.isNull() ? QtScanlineWindow(image) :
+                QtScanlineWindow(original.bits(), original.bytesPerLine(), original.height(),
+                                 size.width(), size.height());
+
+            int         next = 0;
+            for (int y = 0; y < size.height(); y++) {
+                if (!original.isNull()) {
+                    for (; next <= qMin(y + pass.context, size.height() - 1); next++) {
+                        memcpy(original.scanLine(next % original.height()),
+                               image.constScanLine(next), size.width() * sizeof(QRgb));
+                    }
+                }
+                process_pass_row(pass, input, y, 0, size.width(), (QRgb*)image.scanLine(y), states);
+            }
+        }
+
+        if (progress) {
+            progress((i + 1) * 100 / m_passes.size(), context);
+        }
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Prepare the steps of a row pass for an image
+**
+** @param[In] pass          Pass to prepare
+** @param[In] size          Size of the image
+**
+** @return  State of each step
+*/
+FilterGraph::RowStates FilterGraph::prepare_pass(const FilterPass& pass, const QSize& size) {
+    RowStates   states;
+    for (int i = 0; i < pass.steps.size(); i++) {
+        const FilterStep&   step = pass.steps.at(i);
+        states.append(step.filter ? step.filter->prepareRows(size) :
+                                    QSharedPointer<const QtImageFilterRowState>());
+    }
+    return states;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Run the steps of a row pass over pixels of one scanline
+**
+** @param[In] pass          Pass to run
+** @param[In] input         Input image
+** @param[In] y             Scanline of the image
+** @param[In] left          First pixel
+** @param[In] right         Pixel after the last one
+** @param[out] row          Output scanline
+** @param[In] states        State of each step
+*/
+void FilterGraph::process_pass_row(const FilterPass& pass, const QtScanlineWindow& input, int y,
+                                   int left, int right, QRgb* row, const RowStates& states) {
+    // The first step of a neighbourhood pass reads the input rows and
+    // writes the output row, the rest work on the output row in place
+    int     first = 0;
+    if (pass.neighbourhood) {
+        pass.steps.first().filter->applyToRows(input, y, y + 1, left, right, (uchar*)row, 0,
+                                               states.first().data());
+        first = 1;
+    }
+    else if (input.row(y) != row) {
+        memcpy(row + left, input.row(y) + left, (right - left) * sizeof(QRgb));
+    }
+
+    QSize   size(input.width(), input.height());
+    for (int i = first; i < pass.steps.size(); i++) {
+        const FilterStep&   step = pass.steps.at(i);
+        if (step.lut) {
+            step.lut->process_row(row, left, right);
+        }
+        else {
+            step.filter->processRow(row, y, left, right, size, states.at(i).data());
+        }
+    }
+}
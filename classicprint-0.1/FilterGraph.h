@@ -0,0 +1,246 @@
+/*!
+** @file	FilterGraph.h
+**
+** @brief	Chain of image filters, optimised and scheduled by their kind
+**
+*/
+#ifndef __filtergraph__h
+#define __filtergraph__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QImage>
+#include <QList>
+#include <QSharedPointer>
+#include <QtImageFilter>
+#include "PointwiseLut.h"
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Filters applied to an image one after another.
+**
+** Filters are added in the order they apply. The graph is then optimised
+** using the isIdentity() and kind() of each filter:
+**
+**  - filters that leave the image as it is are dropped
+**  - runs of channel lookup filters are collapsed into one lookup table
+**  - runs of pointwise filters (and tables) become one pass that runs
+**    every filter over a scanline before moving to the next
+**  - a neighbourhood filter that can be applied a range of rows at a time
+**    starts a new pass, reading the rows around each one from the output
+**    of the pass before it
+**  - other neighbourhood and geometry filters are applied to the whole
+**    image between those passes
+**
+** A graph that is one pass over the rows can also be run a row at a time
+** by a caller that schedules the rows itself and holds the rows around
+** them, which is how the engine renders the lens, film and processing
+** stages.
+*/
+class FilterGraph {
+public:
+    // What prepareRows() worked out for each step of the row pass
+    typedef QList<QSharedPointer<const QtImageFilterRowState> >  RowStates;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Constructor for an empty graph
+    **
+    */
+    FilterGraph();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Destructor
+    **
+    */
+    ~FilterGraph();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Add a filter after the ones already in the graph
+    **
+    ** @param[In] filter        Filter. The graph takes ownership of it. NULL
+    **                          is ignored, so optional filters can be added
+    **                          as they are created
+    */
+    void    append(QtImageFilter* filter);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Add a filter shared with other users after the ones already
+    **          in the graph. It is only read, never changed
+    **
+    ** @param[In] filter        Filter. NULL is ignored
+    */
+    void    append(const QSharedPointer<const QtImageFilter>& filter);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Plan the passes over the image from the filters and their
+    **          current options. Must be called after the last filter is
+    **          added, and again if their options change
+    **
+    */
+    void    optimise();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the number of passes over the image once optimised
+    **
+    ** @return  Number of passes
+    */
+    int     passes() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Check if the optimised graph can be run a row at a time with
+    **          processRow(). True if every filter left is a channel lookup
+    **          or pointwise filter, apart from a first one that can be
+    **          applied a range of rows at a time, including if there are
+    **          none
+    **
+    ** @return  True/False
+    */
+    bool    isRowPass() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the number of input scanlines either side of a row that
+    **          processRow() reads
+    **
+    ** @return  Number of scanlines, -1 if the graph is not one row pass
+    */
+    int     contextRows() const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Prepare the row pass for an image
+    **
+    ** @param[In] size          Size of the image
+    **
+    ** @return  State of the steps, to pass to processRow()
+    */
+    RowStates prepareRows(const QSize& size) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Run the row pass over pixels [left, right) of one scanline.
+    **          Only for graphs where isRowPass() is true. Rows may be
+    **          processed in any order and from several threads at once
+    **
+    ** @param[In] input         Input image, holding the contextRows()
+    **                          scanlines either side of y
+    ** @param[In] y             Scanline of the image
+    ** @param[In] left          First pixel
+    ** @param[In] right         Pixel after the last one
+    ** @param[out] row          Output scanline, each pixel at its column in
+    **                          the image. May be the input scanline if
+    **                          contextRows() is 0
+    ** @param[In] states        What prepareRows() returned for the image
+    */
+    void    processRow(const QtScanlineWindow& input, int y, int left, int right, QRgb* row,
+                       const RowStates& states) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Run the row pass over pixels [left, right) of one scanline in
+    **          place. Only for graphs where contextRows() is 0
+    **
+    ** @param[In,out] row       Scanline, each pixel at its column in the
+    **                          image
+    ** @param[In] y             Scanline of the image
+    ** @param[In] left          First pixel
+    ** @param[In] right         Pixel after the last one
+    ** @param[In] size          Size of the image
+    ** @param[In] states        What prepareRows() returned for the image
+    */
+    void    processRow(QRgb* row, int y, int left, int right, const QSize& size,
+                       const RowStates& states) const;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Apply the filters to a whole image, optimising the graph first
+    **          if it has not been since the last filter was added
+    **
+    ** @param[In,out] image     Image to filter in place
+    ** @param[In] progress      Optional progress handler, called after each
+    **                          pass
+    ** @param[In] context       Context passed to the progress handler
+    **
+    ** @return True/False
+    */
+    bool    run(QImage& image, void (*progress)(int, void*) = NULL, void* context = NULL);
+
+private:
+    Q_DISABLE_COPY(FilterGraph)
+
+    // One step of a row pass: a filter or a collapsed lookup table
+    struct FilterStep {
+        QSharedPointer<const QtImageFilter> filter;
+        QSharedPointer<PointwiseLut>        lut;
+    };
+
+    // A whole image filter, or a run of row steps if filter is NULL. The
+    // first step of a neighbourhood pass reads context rows either side
+    // of each one through applyToRows()
+    struct FilterPass {
+        QSharedPointer<const QtImageFilter> filter;
+        QList<FilterStep>                   steps;
+        bool                                neighbourhood;
+        int                                 context;
+
+        FilterPass() : neighbourhood(false), context(0) {}
+    };
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Prepare the steps of a row pass for an image
+    **
+    ** @param[In] pass          Pass to prepare
+    ** @param[In] size          Size of the image
+    **
+    ** @return  State of each step
+    */
+    static RowStates prepare_pass(const FilterPass& pass, const QSize& size);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Run the steps of a row pass over pixels of one scanline
+    **
+    ** @param[In] pass          Pass to run
+    ** @param[In] input         Input image
+    ** @param[In] y             Scanline of the image
+    ** @param[In] left          First pixel
+    ** @param[In] right         Pixel after the last one
+    ** @param[out] row          Output scanline
+    ** @param[In] states        State of each step
+    */
+    static void process_pass_row(const FilterPass& pass, const QtScanlineWindow& input, int y,
+                                 int left, int right, QRgb* row, const RowStates& states);
+
+private:
+    QList<QSharedPointer<const QtImageFilter> > m_filters;
+    QList<FilterPass>   m_passes;
+    bool                m_optimised;
+};
+
+
+#endif
@@ -0,0 +1,131 @@
+/*!
+** @file	FilterPool.cpp
+**
+** @brief	Configured filter instances shared between renders
+**
+*/
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include "FilterPool.h"
+#include <QtImageFilterFactory>
+#include <QDataStream>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Constructor
+**
+** @param[In] limit         Most filters to keep
+**
+*/
+FilterPool::FilterPool(int limit)
+    : m_filters(qMax(0, limit)) {
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the most filters kept
+**
+** @param[In] limit         Number of filters. 0 keeps none
+*/
+void FilterPool::setLimit(int limit) {
+    QMutexLocker    locker(&m_lock);
+    m_filters.setMaxCost(qMax(0, limit));
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the most filters kept
+**
+** @return  Number of filters
+*/
+int FilterPool::limit() {
+    QMutexLocker    locker(&m_lock);
+    return m_filters.maxCost();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get a filter with the given options, made if there is none
+**
+** @param[In] name          Name the filter is registered with
+** @param[In] options       Options to set on it
+**
+** @return  Filter, shared with other users so it must not be changed,
+**          or NULL if there is no such filter or an option is rejected
+*/
+QSharedPointer<const QtImageFilter> FilterPool::filter(const QString& name,
+                                                       const FilterOptions& options) {
+    // The options are serialised in order, so equal settings give equal keys
+    QByteArray  key;
+    {
+        QDataStream stream(&key, QIODevice::WriteOnly);
+        stream << name << options;
+    }
+
+    {
+        QMutexLocker    locker(&m_lock);
+        QSharedPointer<const QtImageFilter>*    cached = m_filters.object(key);
+        if (cached) {
+            return *cached;
+        }
+    }
+
+    // Setting the options may decode assets, so other renders are not held
+    // up while the filter is made
+    QSharedPointer<const QtImageFilter> made(create(name, options));
+    if (!made) {
+        return made;
+    }
+
+    QMutexLocker    locker(&m_lock);
+    QSharedPointer<const QtImageFilter>*    cached = m_filters.object(key);
+    if (cached) {
+        // Another render made the same filter first
+        return *cached;
+    }
+    // QCache deletes the copy itself if the limit is 0
+    m_filters.insert(key, new QSharedPointer<const QtImageFilter>(made));
+    return made;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Make a new filter with the given options
+**
+** @param[In] name          Name the filter is registered with
+** @param[In] options       Options to set on it
+**
+** @return  Filter or NULL if there is no such filter or an option is
+**          rejected. The caller takes ownership of the object
+*/
+QtImageFilter* FilterPool::create(const QString& name, const FilterOptions& options) {
+    QtImageFilter*  filter = QtImageFilterFactory::createImageFilter(name);
+    if (!filter) {
+        return NULL;
+    }
+    for (FilterOptions::const_iterator it = options.constBegin(); it != options.constEnd(); ++it) {
+        if (!filter->setOption(it.key(), it.value())) {
+            delete filter;
+            return NULL;
+        }
+    }
+    return filter;
+}
@@ -0,0 +1,121 @@
+/*!
+** @file	FilterPool.h
+**
+** @brief	Configured filter instances shared between renders
+**
+*/
+#ifndef __filterpool__h
+#define __filterpool__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QByteArray>
+#include <QCache>
+#include <QMap>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QVariant>
+#include <QtImageFilter>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+// Default number of configured filters kept
+#define FILTERPOOL_DEFAULT_LIMIT    32
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+// Values of the options of a filter, by option
+typedef QMap<int, QVariant> FilterOptions;
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Pool of configured filters.
+**
+** Filters are reentrant once their options are set, so one instance can be
+** applied from any number of threads and renders at once. The pool keeps
+** the filters it has made, keyed by the filter name and its options, and
+** hands the same instance out again for the same settings. That saves
+** looking up, allocating and setting up every filter for every render,
+** which for some filters means building tables or loading images.
+**
+** Only up to a limit of filters is kept; the least recently used ones
+** beyond it are dropped once nothing uses them. The pool may be used from
+** several threads at once.
+*/
+class FilterPool {
+public:
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Constructor
+    **
+    ** @param[In] limit         Most filters to keep
+    **
+    */
+    FilterPool(int limit = FILTERPOOL_DEFAULT_LIMIT);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Set the most filters kept
+    **
+    ** @param[In] limit         Number of filters. 0 keeps none
+    */
+    void    setLimit(int limit);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the most filters kept
+    **
+    ** @return  Number of filters
+    */
+    int     limit();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get a filter with the given options, made if there is none
+    **
+    ** @param[In] name          Name the filter is registered with
+    ** @param[In] options       Options to set on it
+    **
+    ** @return  Filter, shared with other users so it must not be changed,
+    **          or NULL if there is no such filter or an option is rejected
+    */
+    QSharedPointer<const QtImageFilter> filter(const QString& name,
+                                               const FilterOptions& options);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Make a new filter with the given options
+    **
+    ** @param[In] name          Name the filter is registered with
+    ** @param[In] options       Options to set on it
+    **
+    ** @return  Filter or NULL if there is no such filter or an option is
+    **          rejected. The caller takes ownership of the object
+    */
+    static QtImageFilter* create(const QString& name, const FilterOptions& options);
+
+private:
+    Q_DISABLE_COPY(FilterPool)
+
+    QMutex                      m_lock;
+
+    // Filters by name and options
+    QCache<QByteArray, QSharedPointer<const QtImageFilter> >    m_filters;
+};
+
+
+#endif
@@ -10,7 +10,7 @@
 */
 #include "FrameFilter.h"
 #include <QPainter>
-#include "NoiseFilter.h"
+#include <string.h>
  
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
@@ -35,6 +35,7 @@ register_frame_filter() {
 
 FrameFilter::FrameFilter() {
 	m_frame_size_percent = 5;
+	m_noise_filter.setOption(NoiseFilter::NoisePercent, 60);
 }
 
 QImage FrameFilter::apply(
@@ -46,34 +47,46 @@ QImage FrameFilter::apply(
     int left = 0;
     int right = img.width();
 
-	int frame_width = (int)((double)img.width() * m_frame_size_percent / 100.0);
+	int frame_width = this->frame_width(img.size());
 
     if (!clipRect.isNull()) {
         // If we have a cliprect, set our coordinates to our cliprect
         // and make sure it is within the boundaries of the image
         top = qMax(top, clipRect.top());
-        bottom = qMin(bottom, clipRect.bottom());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
         left = qMax(left, clipRect.left());
-        right = qMin(right, clipRect.right());
+        right = qMin(right, clipRect.right() + 1);
     }
 
     QImage::Format fmt = img.format();
 
+	// An opaque 32-bit image is copied straight into the frame
+	if (fmt == QImage::Format_RGB32) {
+		QImage resultImg(QSize(img.width() + 2 * frame_width, img.height() + 2 * frame_width), fmt);
+		for (int y = 0; y < resultImg.height(); y++) {
+			QRgb* row = (QRgb*)resultImg.scanLine(y);
+			int src_y = y - frame_width;
+			if ((src_y < 0) || (src_y >= img.height())) {
+				process_frame_row(row, y, 0, resultImg.width());
+				continue;
+			}
+			process_frame_row(row, y, 0, frame_width);
+			memcpy(row + frame_width, img.constScanLine(src_y), img.width() * sizeof(QRgb));
+			process_frame_row(row, y, frame_width + img.width(), resultImg.width());
+		}
+		return resultImg;
+	}
+
     // Create a destination image including the frame
     QImage resultImg(QSize(img.width() + 2 * frame_width, img.height() + 2 * frame_width), QImage::Format_ARGB32);
 
-	// Draw the solid frame colour
-	QPainter* painter = new QPainter(&resultImg);
-	painter->fillRect(0, 0, resultImg.width(), resultImg.height(), QColor(229, 217, 203));
-	delete painter;
-
-	// Add noise to it
-	NoiseFilter noise_filter;
-	noise_filter.setOption(NoiseFilter::NoisePercent, 60);
-	resultImg = noise_filter.apply(resultImg);
+	// Draw the solid frame colour with noise added to it
+	for (int y = 0; y < resultImg.height(); y++) {
+		process_frame_row((QRgb*)resultImg.scanLine(y), y, 0, resultImg.width());
+	}
 
 	// Put the image in the centre
-	painter = new QPainter(&resultImg);
+	QPainter* painter = new QPainter(&resultImg);
 	painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
     painter->drawImage(frame_width, frame_width, img);
     delete painter;
@@ -84,6 +97,37 @@ QImage FrameFilter::apply(
     return resultImg;
 }
 
+int FrameFilter::frame_width(
+	const QSize& size
+) const {
+	return (int)((double)size.width() * m_frame_size_percent / 100.0);
+}
+
+void FrameFilter::process_frame_row(
+	QRgb* row,
+	int y,
+	int left,
+	int right
+) const {
+	QRgb colour = qRgb(229, 217, 203);
+	for (int x = left; x < right; x++) {
+		row[x] = colour;
+	}
+	m_noise_filter.process_row(row, y, left, right);
+}
+
+QtImageFilter::FilterKind
+FrameFilter::kind(
+) const {
+	return GeometryFilter;
+}
+
+bool
+FrameFilter::isIdentity(
+) const {
+	return m_frame_size_percent <= 0.0;
+}
+
 QString
 FrameFilter::name(
 ) const {
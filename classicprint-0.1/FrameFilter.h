@@ -12,6 +12,7 @@
 */
 #include <QtImageFilter>
 #include <QByteArray>
+#include "NoiseFilter.h"
  
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
@@ -46,6 +47,17 @@ public:
 
 	virtual QImage apply(const QImage &img, const QRect& clipRect = QRect()) const;
 
+	// Width of the frame added to each side of an image of the given size
+	int frame_width(const QSize& size) const;
+
+	// Draw the frame texture over pixels [left, right) of scanline y of
+	// the framed image
+	void process_frame_row(QRgb* row, int y, int left, int right) const;
+
+	virtual FilterKind kind() const;
+
+	virtual bool isIdentity() const;
+
 	virtual QString name() const;
 
 	virtual QVariant option(int filteroption) const;
@@ -60,6 +72,7 @@ private:
 	
 private:
 		double				m_frame_size_percent;
+		NoiseFilter			m_noise_filter;
 };
 
 #endif
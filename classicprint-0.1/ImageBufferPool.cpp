@@ -0,0 +1,194 @@
+/*!
+** @file	ImageBufferPool.cpp
+**
+** @brief	Reusable aligned pixel buffers for images used during a render
+**
+*/
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include "ImageBufferPool.h"
+#include <QtGlobal>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Constructor
+**
+** @param[In] limit         Most kilobytes of idle buffers to keep
+**
+*/
+ImageBufferPool::ImageBufferPool(int limit) {
+    m_idle_bytes = 0;
+    m_limit_bytes = (qint64)limit * 1024;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Destructor. Every PooledImage must have been released
+**
+*/
+ImageBufferPool::~ImageBufferPool() {
+    setLimit(0);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the most memory kept in idle buffers
+**
+** @param[In] limit         Limit in kilobytes. 0 frees buffers as soon as
+**                          they are released
+*/
+void ImageBufferPool::setLimit(int limit) {
+    QMutexLocker    locker(&m_lock);
+    m_limit_bytes = (qint64)limit * 1024;
+    trim();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the most memory kept in idle buffers
+**
+** @return  Limit in kilobytes
+*/
+int ImageBufferPool::limit() {
+    QMutexLocker    locker(&m_lock);
+    return (int)(m_limit_bytes / 1024);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Take an idle buffer of exactly the given size, or allocate one
+**
+** @param[In] bytes         Size of the buffer
+**
+** @return  Aligned buffer or NULL if out of memory
+*/
+uchar* ImageBufferPool::take(int bytes) {
+    {
+        QMutexLocker    locker(&m_lock);
+        for (int i = 0; i < m_idle.size(); i++) {
+            if (m_idle.at(i).first == bytes) {
+                uchar*  buffer = m_idle.at(i).second;
+                m_idle.removeAt(i);
+                m_idle_bytes -= bytes;
+                return buffer;
+            }
+        }
+    }
+    return (uchar*)qMallocAligned(bytes, IMAGEBUFFERPOOL_ALIGNMENT);
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Put a buffer back for reuse
+**
+** @param[In] buffer        Buffer from take()
+** @param[In] bytes         Size of the buffer
+*/
+void ImageBufferPool::give(uchar* buffer, int bytes) {
+    QMutexLocker    locker(&m_lock);
+    m_idle.prepend(qMakePair(bytes, buffer));
+    m_idle_bytes += bytes;
+    trim();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Free the least recently used idle buffers until the limit is
+**          met. The lock must be held
+*/
+void ImageBufferPool::trim() {
+    while (!m_idle.isEmpty() && (m_idle_bytes > m_limit_bytes)) {
+        QPair<int, uchar*>  oldest = m_idle.takeLast();
+        m_idle_bytes -= oldest.first;
+        qFreeAligned(oldest.second);
+    }
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Constructor for an empty image
+**
+*/
+PooledImage::PooledImage() {
+    m_pool = NULL;
+    m_buffer = NULL;
+    m_bytes = 0;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Destructor. Gives the buffer back to the pool
+**
+*/
+PooledImage::~PooledImage() {
+    release();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Borrow a buffer for an image, releasing any held before
+**
+** @param[In] pool          Pool to borrow from. If NULL the image is
+**                          allocated as usual
+** @param[In] size          Size of the image
+** @param[In] format        Format of the image. Must be a 32-bit format
+**
+** @return True/False
+*/
+bool PooledImage::create(ImageBufferPool* pool, const QSize& size, QImage::Format format) {
+    release();
+
+    if (!pool) {
+        m_image = QImage(size, format);
+        return !m_image.isNull();
+    }
+    if (size.isEmpty()) {
+        return false;
+    }
+
+    // Pad scanlines so every one starts aligned
+    int     bytes_per_line = (size.width() * 4 + IMAGEBUFFERPOOL_ALIGNMENT - 1) &
+                             ~(IMAGEBUFFERPOOL_ALIGNMENT - 1);
+    int     bytes = bytes_per_line * size.height();
+    m_buffer = pool->take(bytes);
+    if (!m_buffer) {
+        return false;
+    }
+    m_pool = pool;
+    m_bytes = bytes;
+    m_image = QImage(m_buffer, size.width(), size.height(), bytes_per_line, format);
+    return true;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Give the buffer back to the pool
+**
+*/
+void PooledImage::release() {
+    m_image = QImage();
+    if (m_pool) {
+        m_pool->give(m_buffer, m_bytes);
+    }
+    m_pool = NULL;
+    m_buffer = NULL;
+    m_bytes = 0;
+}
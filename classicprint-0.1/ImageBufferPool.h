@@ -0,0 +1,151 @@
+/*!
+** @file	ImageBufferPool.h
+**
+** @brief	Reusable aligned pixel buffers for images used during a render
+**
+*/
+#ifndef __imagebufferpool__h
+#define __imagebufferpool__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+// Alignment in bytes of every buffer and of every scanline in it. Enough
+// for the widest vector loads and stores
+#define IMAGEBUFFERPOOL_ALIGNMENT       32
+
+// Default limit in kilobytes of the idle buffers kept for reuse
+#define IMAGEBUFFERPOOL_DEFAULT_LIMIT   (16 * 1024)
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Pool of pixel buffers for 32-bit images.
+**
+** Previews of the same size are rendered over and over while the settings
+** are edited. Rather than allocating and freeing the same large buffers
+** every time, buffers that are no longer used are kept and handed out again
+** for the next image of the same size. Only up to a limit of idle memory is
+** kept; the least recently used buffers beyond it are freed.
+**
+** Buffers are handed out through PooledImage. The pool may be used from
+** several threads at once.
+*/
+class ImageBufferPool {
+public:
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Constructor
+    **
+    ** @param[In] limit         Most kilobytes of idle buffers to keep
+    **
+    */
+    ImageBufferPool(int limit = IMAGEBUFFERPOOL_DEFAULT_LIMIT);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Destructor. Every PooledImage must have been released
+    **
+    */
+    ~ImageBufferPool();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Set the most memory kept in idle buffers
+    **
+    ** @param[In] limit         Limit in kilobytes. 0 frees buffers as soon as
+    **                          they are released
+    */
+    void    setLimit(int limit);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the most memory kept in idle buffers
+    **
+    ** @return  Limit in kilobytes
+    */
+    int     limit();
+
+private:
+    friend class PooledImage;
+
+    uchar*  take(int bytes);
+    void    give(uchar* buffer, int bytes);
+    void    trim();
+
+private:
+    QMutex                      m_lock;
+
+    // Idle buffers and their sizes, most recently released first
+    QList<QPair<int, uchar*> >  m_idle;
+    qint64                      m_idle_bytes;
+    qint64                      m_limit_bytes;
+};
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   32-bit image whose pixels are borrowed from an ImageBufferPool.
+**
+** The buffer goes back to the pool when the PooledImage is released or
+** destroyed, so the image must not be copied anywhere that outlives it.
+*/
+class PooledImage {
+public:
+    PooledImage();
+    ~PooledImage();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Borrow a buffer for an image, releasing any held before
+    **
+    ** @param[In] pool          Pool to borrow from. If NULL the image is
+    **                          allocated as usual
+    ** @param[In] size          Size of the image
+    ** @param[In] format        Format of the image. Must be a 32-bit format
+    **
+    ** @return True/False
+    */
+    bool    create(ImageBufferPool* pool, const QSize& size, QImage::Format format);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Give the buffer back to the pool
+    **
+    */
+    void    release();
+
+    QImage& image() {
+        return m_image;
+    }
+
+private:
+    Q_DISABLE_COPY(PooledImage)
+
+    ImageBufferPool*    m_pool;
+    uchar*              m_buffer;
+    int                 m_bytes;
+    QImage              m_image;
+};
+
+
+#endif
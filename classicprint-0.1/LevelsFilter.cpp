@@ -9,6 +9,7 @@
 ** Includes 
 */
 #include "LevelsFilter.h"
+#include "PointwiseLut.h"
 #include "utils.h"
 #include <stdint.h>
  
@@ -46,6 +47,15 @@ LevelsFilter::LevelsFilter() {
 QImage LevelsFilter::apply(
 	const QImage &img,
  	const QRect& clipRect
+) const {
+	QImage resultImg = img;
+	applyInPlace(resultImg, clipRect);
+	return resultImg;
+}
+
+bool LevelsFilter::applyInPlace(
+	QImage &img,
+ 	const QRect& clipRect
 ) const {
     int top = 0;
     int bottom = img.height();
@@ -56,49 +66,102 @@ QImage LevelsFilter::apply(
         // If we have a cliprect, set our coordinates to our cliprect
         // and make sure it is within the boundaries of the image
         top = qMax(top, clipRect.top());
-        bottom = qMin(bottom, clipRect.bottom());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
         left = qMax(left, clipRect.left());
-        right = qMin(right, clipRect.right());
+        right = qMin(right, clipRect.right() + 1);
     }
 
 
+    // The rows are processed where they are. Only formats other than
+    // 32-bit need a converted copy
     QImage::Format fmt = img.format();
-    QImage resultImg = img.convertToFormat(QImage::Format_ARGB32);
+    if ((fmt != QImage::Format_RGB32) && (fmt != QImage::Format_ARGB32)) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    }
 
-    int x;
-    int y;
+    // Every channel is a function of its own value, so one table does it
+    PointwiseLut lut;
+    lut.append(*this);
 
-	uchar* bits = resultImg.bits();
+    int y;
 
 	for (y = top; y < bottom; y++) {
-		for (x = left; x < right; x++) {
-			// Read the pixel data
-			QRgb rgb = ((uint32_t*)bits)[x];
-
-			// Read from the level lookup arrays
-			int red = m_red_levels[qRed(rgb)];
-			int green = m_green_levels[qGreen(rgb)];
-			int blue = m_blue_levels[qBlue(rgb)];
-
-			// Apply to the selected channels
-			red = m_scale_red ? red : qRed(rgb);
-			green = m_scale_green ? green : qGreen(rgb);
-			blue = m_scale_blue ? blue : qBlue(rgb);
-
-			// Merge back with the main image
-			red = merge_colours(red, qRed(rgb), m_percent, 100);
-			green = merge_colours(green, qGreen(rgb), m_percent, 100);
-			blue = merge_colours(blue, qBlue(rgb), m_percent, 100);
-
-			((uint32_t*)bits)[x] = qRgb(red, green, blue);
-		}
-		bits += resultImg.bytesPerLine();
+		lut.process_row((QRgb*)img.scanLine(y), left, right);
 	}
-    
-	if (resultImg.format() != fmt) {
-        resultImg = resultImg.convertToFormat(fmt);
+
+    if (img.format() != fmt) {
+        img = img.convertToFormat(fmt);
     }
-    return resultImg;
+    return true;
+}
+
+void LevelsFilter::process_row(
+	QRgb* row,
+	int left,
+	int right
+) const {
+	for (int x = left; x < right; x++) {
+		// Read the pixel data
+		QRgb rgb = row[x];
+
+		// Read from the level lookup arrays
+		int red = m_red_levels[qRed(rgb)];
+		int green = m_green_levels[qGreen(rgb)];
+		int blue = m_blue_levels[qBlue(rgb)];
+
+		// Apply to the selected channels
+		red = m_scale_red ? red : qRed(rgb);
+		green = m_scale_green ? green : qGreen(rgb);
+		blue = m_scale_blue ? blue : qBlue(rgb);
+
+		// Merge back with the main image
+		red = merge_colours(red, qRed(rgb), m_percent, 100);
+		green = merge_colours(green, qGreen(rgb), m_percent, 100);
+		blue = merge_colours(blue, qBlue(rgb), m_percent, 100);
+
+		row[x] = qRgb(red, green, blue);
+	}
+}
+
+QtImageFilter::FilterKind
+LevelsFilter::kind(
+) const {
+	return ChannelLookupFilter;
+}
+
+void
+LevelsFilter::processRow(
+	QRgb* row,
+	int y,
+	int left,
+	int right,
+	const QSize& size,
+	const QtImageFilterRowState* state
+) const {
+	Q_UNUSED(y);
+	Q_UNUSED(size);
+	Q_UNUSED(state);
+	process_row(row, left, right);
+}
+
+bool
+LevelsFilter::isIdentity(
+) const {
+	if (m_percent == 0) {
+		return true;
+	}
+	// Only at 100% is the result exactly the table entry
+	if (m_percent != 100) {
+		return false;
+	}
+	for (int i = 0; i < 256; ++i) {
+		if ((m_scale_red && (m_red_levels[i] != i)) ||
+			(m_scale_green && (m_green_levels[i] != i)) ||
+			(m_scale_blue && (m_blue_levels[i] != i))) {
+			return false;
+		}
+	}
+	return true;
 }
 
 QString
@@ -44,6 +44,19 @@ public:
 
 	virtual QImage apply(const QImage &img, const QRect& clipRect = QRect()) const;
 
+	virtual bool applyInPlace(QImage &img, const QRect& clipRect = QRect()) const;
+
+	// Apply the levels to pixels [left, right) of one scanline in place
+	void process_row(QRgb* row, int left, int right) const;
+
+	virtual FilterKind kind() const;
+
+	virtual bool isIdentity() const;
+
+	// Apply the levels to pixels [left, right) of one scanline in place
+	virtual void processRow(QRgb *row, int y, int left, int right, const QSize &size,
+							const QtImageFilterRowState *state) const;
+
 	virtual QString name() const;
 
 	virtual QVariant option(int filteroption) const;
@@ -10,6 +10,8 @@
 */
 #include "NoiseFilter.h"
 #include "utils.h"
+#include "AssetCache.h"
+#include "PixelKernels.h"
 #include <stdint.h>
  
 /*--------------------------------------------------------------------------- 
@@ -35,14 +37,22 @@ register_noise_filter() {
 
 NoiseFilter::NoiseFilter() {
     m_noise_percent = 0.0;
-    m_noise_image.load(":/classicPrintData/noise/noise.jpg");
+    m_noise_image = AssetCache::image(":/classicPrintData/noise/noise.jpg");
 }
 
 QImage NoiseFilter::apply(
 	const QImage &img,
  	const QRect& clipRect
-        ) const {
-    int x;
+) const {
+	QImage resultImg = img;
+	applyInPlace(resultImg, clipRect);
+	return resultImg;
+}
+
+bool NoiseFilter::applyInPlace(
+	QImage &img,
+ 	const QRect& clipRect
+) const {
     int y;
     int top = 0;
     int bottom = img.height();
@@ -53,59 +63,79 @@ QImage NoiseFilter::apply(
         // If we have a cliprect, set our coordinates to our cliprect
         // and make sure it is within the boundaries of the image
         top = qMax(top, clipRect.top());
-        bottom = qMin(bottom, clipRect.bottom());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
         left = qMax(left, clipRect.left());
-        right = qMin(right, clipRect.right());
+        right = qMin(right, clipRect.right() + 1);
     }
 
     QImage::Format fmt = img.format();
-    QImage resultImg = img.convertToFormat(QImage::Format_ARGB32);
+    if ((fmt != QImage::Format_RGB32) && (fmt != QImage::Format_ARGB32)) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    }
+
+    for (y = top; y < bottom; y++) {
+		process_row((QRgb*)img.scanLine(y), y, left, right);
+    }
+
+    if (img.format() != fmt) {
+        img = img.convertToFormat(fmt);
+    }
+    return true;
+}
+
+void NoiseFilter::process_row(
+	QRgb* row,
+	int y,
+	int left,
+	int right
+) const {
+	// Without a noise texture there is nothing to overlay, and no size to
+	// wrap it around
+	if (isIdentity()) {
+		return;
+	}
 
 	int noise_width = m_noise_image.width();
 	int noise_height = m_noise_image.height();
 
-	uchar* bits = resultImg.bits();
-	const uchar* bits_noise = m_noise_image.bits();
+	// Noise image wraps around if it is smaller than the main image
+	int noise_y = y % noise_height;
+	const QRgb* bits_noise = (const QRgb*)m_noise_image.scanLine(noise_y);
+
+	// Overlay it one unwrapped run at a time
+	int noise_x = left % noise_width;
+	for (int x = left; x < right; ) {
+		int count = qMin(right - x, noise_width - noise_x);
+		overlay_noise_row(row + x, bits_noise + noise_x, count, (int)m_noise_percent);
+		x += count;
+		noise_x = 0;
+	}
+}
 
-    for (y = top; y < bottom; y++) {
-		// Noise image wraps around if it is smaller than the main image
-		int noise_y = y % noise_height;
-		bits_noise = m_noise_image.bits() + m_noise_image.bytesPerLine() * noise_y;
-		for (x = left; x < right; x++) {
-            int noise_x = x % noise_width;
-
-			// Get a pointer to the image data
-			QRgb rgb = ((uint32_t*)bits)[x];
-			QRgb rgb_noise = ((uint32_t*)bits_noise)[noise_x];
-
-			// Merge the noise image with the main image
-			int red = qBound(0, merge_colours(qRed(rgb_noise), 128, (int)m_noise_percent, 100), 255);
-			int green = qBound(0, merge_colours(qGreen(rgb_noise), 128, (int)m_noise_percent, 100), 255);
-			int blue = qBound(0, merge_colours(qBlue(rgb_noise), 128, (int)m_noise_percent, 100), 255);
-
-			red = (qRed(rgb) < 128) ?
-				  (2 * qRed(rgb) * red / 255) :
-				  (255 - (2 * (255 - qRed(rgb)) * (255 - red) / 255));
-			green = (qGreen(rgb) < 128) ?
-				  (2 * qGreen(rgb) * green / 255) :
-				  (255 - (2 * (255 - qGreen(rgb)) * (255 - green) / 255));
-			blue = (qBlue(rgb) < 128) ?
-				  (2 * qBlue(rgb) * blue / 255) :
-				  (255 - (2 * (255 - qBlue(rgb)) * (255 - blue) / 255));
-
-			red = qBound(0, red, 255);
-			green = qBound(0, green, 255);
-			blue = qBound(0, blue, 255);
-
-			((uint32_t*)bits)[x] = qRgb(red, green, blue);
-        }
-		bits += resultImg.bytesPerLine();
-    }
-    
-    if (resultImg.format() != fmt) {
-        resultImg = resultImg.convertToFormat(fmt);
-    }
-    return resultImg;
+QtImageFilter::FilterKind
+NoiseFilter::kind(
+) const {
+	return PointwiseFilter;
+}
+
+void
+NoiseFilter::processRow(
+	QRgb* row,
+	int y,
+	int left,
+	int right,
+	const QSize& size,
+	const QtImageFilterRowState* state
+) const {
+	Q_UNUSED(size);
+	Q_UNUSED(state);
+	process_row(row, y, left, right);
+}
+
+bool
+NoiseFilter::isIdentity(
+) const {
+	return ((int)m_noise_percent == 0) || m_noise_image.isNull();
 }
 
 QString
@@ -41,6 +41,20 @@ public:
 
 	virtual QImage apply(const QImage &img, const QRect& clipRect = QRect()) const;
 
+	virtual bool applyInPlace(QImage &img, const QRect& clipRect = QRect()) const;
+
+	// Add noise to pixels [left, right) of scanline y in place. Rows are left
+	// alone if the noise texture failed to load
+	void process_row(QRgb* row, int y, int left, int right) const;
+
+	virtual FilterKind kind() const;
+
+	virtual bool isIdentity() const;
+
+	// Overlay the grain on pixels [left, right) of one scanline in place
+	virtual void processRow(QRgb *row, int y, int left, int right, const QSize &size,
+							const QtImageFilterRowState *state) const;
+
 	virtual QString name() const;
 
 	virtual QVariant option(int filteroption) const;
@@ -0,0 +1,384 @@
+/*! 
+** @file	PixelKernels.cpp
+** 
+** @brief	Vectorised per-pixel blends, picked for the CPU at runtime
+**  
+*/  
+ 
+/*--------------------------------------------------------------------------- 
+** Includes 
+*/
+#include "PixelKernels.h"
+#include "utils.h"
+
+/*--------------------------------------------------------------------------- 
+** Defines and Macros 
+*/
+
+// The x86 versions are built with per-function target attributes, so the
+// rest of the program needs no special compiler flags and still runs on
+// CPUs without them
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define PIXELKERNELS_X86
+#define TARGET(isa)	__attribute__((target(isa)))
+#include <immintrin.h>
+#endif
+ 
+/*--------------------------------------------------------------------------- 
+** Typedefs 
+*/ 
+
+struct PixelKernels {
+	const char*	name;
+	void		(*screen_row)(QRgb* row, const QRgb* blend, int count);
+	void		(*overlay_noise_row)(QRgb* row, const QRgb* noise, int count, int percent);
+};
+ 
+/*--------------------------------------------------------------------------- 
+** Local function prototypes 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Data 
+*/
+
+//---------------------------------------------------------------------------
+// Scalar versions. The formulas here define the results the others must
+// match
+
+static void screen_row_scalar(
+	QRgb* row,
+	const QRgb* blend,
+	int count
+) {
+	for (int x = 0; x < count; x++) {
+		// Read the pixel data
+		QRgb rgb_image = row[x];
+		QRgb rgb_blend = blend[x];
+
+		int red = qRed(rgb_image) + qRed(rgb_blend) -
+					 (qRed(rgb_blend) * qRed(rgb_image) / 255.0);
+		int green = qGreen(rgb_image) + qGreen(rgb_blend) -
+					 (qGreen(rgb_blend) * qGreen(rgb_image) / 255.0);
+		int blue = qBlue(rgb_image) + qBlue(rgb_blend) -
+					 (qBlue(rgb_blend) * qBlue(rgb_image) / 255.0);
+
+		row[x] = qRgb(red, green, blue);
+	}
+}
+
+// Grain level of a noise byte, faded towards mid grey by percent
+static inline int grain_level(
+	int noise,
+	int percent
+) {
+	return qBound(0, merge_colours(noise, 128, percent, 100), 255);
+}
+
+// Overlay of a grain level over an image byte
+static inline int overlay_colour(
+	int colour,
+	int level
+) {
+	colour = (colour < 128) ?
+			 (2 * colour * level / 255) :
+			 (255 - (2 * (255 - colour) * (255 - level) / 255));
+	return qBound(0, colour, 255);
+}
+
+static void overlay_noise_row_formula(
+	QRgb* row,
+	const QRgb* noise,
+	int count,
+	int percent
+) {
+	for (int x = 0; x < count; x++) {
+		QRgb rgb = row[x];
+		QRgb rgb_noise = noise[x];
+
+		// Merge the noise image with the main image
+		int red = overlay_colour(qRed(rgb), grain_level(qRed(rgb_noise), percent));
+		int green = overlay_colour(qGreen(rgb), grain_level(qGreen(rgb_noise), percent));
+		int blue = overlay_colour(qBlue(rgb), grain_level(qBlue(rgb_noise), percent));
+
+		row[x] = qRgb(red, green, blue);
+	}
+}
+
+// The overlay depends only on the image byte and the grain level, and the
+// grain level only on the noise byte and the percent. Both are tabulated
+// the first time they are needed, so the scalar overlay does no divisions
+class OverlayTables {
+public:
+	OverlayTables() {
+		for (int percent = 0; percent <= 100; percent++) {
+			for (int noise = 0; noise < 256; noise++) {
+				levels[percent][noise] = grain_level(noise, percent);
+			}
+		}
+		for (int level = 0; level < 256; level++) {
+			for (int colour = 0; colour < 256; colour++) {
+				overlay[level][colour] = overlay_colour(colour, level);
+			}
+		}
+	}
+
+	uchar	levels[101][256];
+	uchar	overlay[256][256];
+};
+
+static const OverlayTables& overlay_tables() {
+	static const OverlayTables tables;
+	return tables;
+}
+
+// Percent must be 0 to 100
+static void overlay_noise_row_scalar(
+	QRgb* row,
+	const QRgb* noise,
+	int count,
+	int percent
+) {
+	const OverlayTables& tables = overlay_tables();
+	const uchar* levels = tables.levels[percent];
+	for (int x = 0; x < count; x++) {
+		QRgb rgb = row[x];
+		QRgb rgb_noise = noise[x];
+		row[x] = qRgb(tables.overlay[levels[qRed(rgb_noise)]][qRed(rgb)],
+					  tables.overlay[levels[qGreen(rgb_noise)]][qGreen(rgb)],
+					  tables.overlay[levels[qBlue(rgb_noise)]][qBlue(rgb)]);
+	}
+}
+
+static const PixelKernels scalar_kernels = {
+	"scalar", screen_row_scalar, overlay_noise_row_scalar
+};
+
+#ifdef PIXELKERNELS_X86
+//---------------------------------------------------------------------------
+// SSE2 versions. Channels are widened to 16 bits, four pixels at a time.
+//
+// Every product below fits in 16 bits unsigned:
+//   screen     r * b + 254                 <= 65279
+//   noise      n * percent                 <= 25500
+//   overlay    2 * c * n for c < 128       <= 64770
+//              2 * (255 - c) * (255 - n)
+//                        for c >= 128      <= 64770
+// and for those ranges the divisions are exact as multiply and shift:
+//   x / 255 == (x * 0x8081) >> 23
+//   x / 100 == (x * 20972) >> 21
+// Lanes that would overflow (the alpha channel, and the overlay branch not
+// taken) are discarded.
+
+TARGET("sse2") static inline __m128i div255_sse2(__m128i x) {
+	return _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_set1_epi16((short)0x8081)), 7);
+}
+
+TARGET("sse2") static inline __m128i div100_sse2(__m128i x) {
+	return _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_set1_epi16(20972)), 5);
+}
+
+TARGET("sse2") static inline __m128i screen_sse2(__m128i c, __m128i b) {
+	__m128i product = _mm_add_epi16(_mm_mullo_epi16(c, b), _mm_set1_epi16(254));
+	return _mm_sub_epi16(_mm_add_epi16(c, b), div255_sse2(product));
+}
+
+TARGET("sse2") static inline __m128i overlay_noise_sse2(
+	__m128i c,
+	__m128i n,
+	__m128i percent,
+	__m128i grey
+) {
+	const __m128i k255 = _mm_set1_epi16(255);
+	__m128i level = _mm_add_epi16(div100_sse2(_mm_mullo_epi16(n, percent)), grey);
+	__m128i dark = div255_sse2(_mm_mullo_epi16(_mm_add_epi16(c, c), level));
+	__m128i inverse = _mm_sub_epi16(k255, c);
+	__m128i light = _mm_sub_epi16(k255, div255_sse2(
+			_mm_mullo_epi16(_mm_add_epi16(inverse, inverse), _mm_sub_epi16(k255, level))));
+	__m128i is_dark = _mm_cmplt_epi16(c, _mm_set1_epi16(128));
+	return _mm_or_si128(_mm_and_si128(is_dark, dark), _mm_andnot_si128(is_dark, light));
+}
+
+TARGET("sse2") static void screen_row_sse2(
+	QRgb* row,
+	const QRgb* blend,
+	int count
+) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+	int x = 0;
+	for (; x + 4 <= count; x += 4) {
+		__m128i c = _mm_loadu_si128((const __m128i*)(row + x));
+		__m128i b = _mm_loadu_si128((const __m128i*)(blend + x));
+		__m128i lo = screen_sse2(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(b, zero));
+		__m128i hi = screen_sse2(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(b, zero));
+		_mm_storeu_si128((__m128i*)(row + x), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+	}
+	screen_row_scalar(row + x, blend + x, count - x);
+}
+
+TARGET("sse2") static void overlay_noise_row_sse2(
+	QRgb* row,
+	const QRgb* noise,
+	int count,
+	int percent
+) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+	const __m128i fade = _mm_set1_epi16(percent);
+	const __m128i grey = _mm_set1_epi16(128 * (100 - percent) / 100);
+	int x = 0;
+	for (; x + 4 <= count; x += 4) {
+		__m128i c = _mm_loadu_si128((const __m128i*)(row + x));
+		__m128i n = _mm_loadu_si128((const __m128i*)(noise + x));
+		__m128i lo = overlay_noise_sse2(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(n, zero),
+										fade, grey);
+		__m128i hi = overlay_noise_sse2(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(n, zero),
+										fade, grey);
+		_mm_storeu_si128((__m128i*)(row + x), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+	}
+	overlay_noise_row_scalar(row + x, noise + x, count - x, percent);
+}
+
+static const PixelKernels sse2_kernels = {
+	"sse2", screen_row_sse2, overlay_noise_row_sse2
+};
+
+//---------------------------------------------------------------------------
+// AVX2 versions. The same arithmetic as SSE2, eight pixels at a time. The
+// unpacks and packs both work within 128-bit lanes, so pixels come back out
+// in the order they went in
+
+TARGET("avx2") static inline __m256i div255_avx2(__m256i x) {
+	return _mm256_srli_epi16(_mm256_mulhi_epu16(x, _mm256_set1_epi16((short)0x8081)), 7);
+}
+
+TARGET("avx2") static inline __m256i div100_avx2(__m256i x) {
+	return _mm256_srli_epi16(_mm256_mulhi_epu16(x, _mm256_set1_epi16(20972)), 5);
+}
+
+TARGET("avx2") static inline __m256i screen_avx2(__m256i c, __m256i b) {
+	__m256i product = _mm256_add_epi16(_mm256_mullo_epi16(c, b), _mm256_set1_epi16(254));
+	return _mm256_sub_epi16(_mm256_add_epi16(c, b), div255_avx2(product));
+}
+
+TARGET("avx2") static inline __m256i overlay_noise_avx2(
+	__m256i c,
+	__m256i n,
+	__m256i percent,
+	__m256i grey
+) {
+	const __m256i k255 = _mm256_set1_epi16(255);
+	__m256i level = _mm256_add_epi16(div100_avx2(_mm256_mullo_epi16(n, percent)), grey);
+	__m256i dark = div255_avx2(_mm256_mullo_epi16(_mm256_add_epi16(c, c), level));
+	__m256i inverse = _mm256_sub_epi16(k255, c);
+	__m256i light = _mm256_sub_epi16(k255, div255_avx2(
+			_mm256_mullo_epi16(_mm256_add_epi16(inverse, inverse), _mm256_sub_epi16(k255, level))));
+	__m256i is_dark = _mm256_cmpgt_epi16(_mm256_set1_epi16(128), c);
+	return _mm256_blendv_epi8(light, dark, is_dark);
+}
+
+TARGET("avx2") static void screen_row_avx2(
+	QRgb* row,
+	const QRgb* blend,
+	int count
+) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i opaque = _mm256_set1_epi32((int)0xff000000);
+	int x = 0;
+	for (; x + 8 <= count; x += 8) {
+		__m256i c = _mm256_loadu_si256((const __m256i*)(row + x));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(blend + x));
+		__m256i lo = screen_avx2(_mm256_unpacklo_epi8(c, zero), _mm256_unpacklo_epi8(b, zero));
+		__m256i hi = screen_avx2(_mm256_unpackhi_epi8(c, zero), _mm256_unpackhi_epi8(b, zero));
+		_mm256_storeu_si256((__m256i*)(row + x),
+							_mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+	}
+	screen_row_sse2(row + x, blend + x, count - x);
+}
+
+TARGET("avx2") static void overlay_noise_row_avx2(
+	QRgb* row,
+	const QRgb* noise,
+	int count,
+	int percent
+) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i opaque = _mm256_set1_epi32((int)0xff000000);
+	const __m256i fade = _mm256_set1_epi16(percent);
+	const __m256i grey = _mm256_set1_epi16(128 * (100 - percent) / 100);
+	int x = 0;
+	for (; x + 8 <= count; x += 8) {
+		__m256i c = _mm256_loadu_si256((const __m256i*)(row + x));
+		__m256i n = _mm256_loadu_si256((const __m256i*)(noise + x));
+		__m256i lo = overlay_noise_avx2(_mm256_unpacklo_epi8(c, zero),
+										_mm256_unpacklo_epi8(n, zero), fade, grey);
+		__m256i hi = overlay_noise_avx2(_mm256_unpackhi_epi8(c, zero),
+										_mm256_unpackhi_epi8(n, zero), fade, grey);
+		_mm256_storeu_si256((__m256i*)(row + x),
+							_mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+	}
+	overlay_noise_row_sse2(row + x, noise + x, count - x, percent);
+}
+
+static const PixelKernels avx2_kernels = {
+	"avx2", screen_row_avx2, overlay_noise_row_avx2
+};
+#endif
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Pick the widest kernels the CPU runs
+**
+** @return  Kernels
+*/
+static const PixelKernels& select_kernels() {
+#ifdef PIXELKERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return avx2_kernels;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return sse2_kernels;
+	}
+#endif
+	return scalar_kernels;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the kernels in use, picking them the first time
+**
+** @return  Kernels
+*/
+static const PixelKernels& kernels() {
+	static const PixelKernels& selected = select_kernels();
+	return selected;
+}
+
+void screen_row(
+	QRgb* row,
+	const QRgb* blend,
+	int count
+) {
+	kernels().screen_row(row, blend, count);
+}
+
+void overlay_noise_row(
+	QRgb* row,
+	const QRgb* noise,
+	int count,
+	int percent
+) {
+	// The tables and the vector versions only cover 0 to 100 percent
+	if ((percent < 0) || (percent > 100)) {
+		overlay_noise_row_formula(row, noise, count, percent);
+		return;
+	}
+	kernels().overlay_noise_row(row, noise, count, percent);
+}
+
+const char* pixel_kernels_name() {
+	return kernels().name;
+}
@@ -0,0 +1,46 @@
+/*! 
+** @file	PixelKernels.h
+** 
+** @brief	Vectorised per-pixel blends, picked for the CPU at runtime
+**  
+*/  
+#ifndef __pixelkernels__h
+#define __pixelkernels__h
+ 
+/*--------------------------------------------------------------------------- 
+** Includes 
+*/
+#include <QRgb>
+
+/*--------------------------------------------------------------------------- 
+** Defines and Macros 
+*/
+ 
+/*--------------------------------------------------------------------------- 
+** Typedefs 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Local function prototypes 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Data 
+*/
+
+// Each kernel has a scalar version and, where the compiler supports them,
+// SSE2 and AVX2 versions. The widest one the CPU runs is picked the first
+// time a kernel is used. All versions give exactly the same output.
+
+// Screen blend count pixels of blend over row in place. The result is
+// opaque
+void screen_row(QRgb* row, const QRgb* blend, int count);
+
+// Overlay count pixels of noise, faded towards mid grey by percent, over row
+// in place. The result is opaque
+void overlay_noise_row(QRgb* row, const QRgb* noise, int count, int percent);
+
+// Name of the kernels in use, for diagnostics
+const char* pixel_kernels_name();
+
+#endif
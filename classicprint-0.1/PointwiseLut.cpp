@@ -0,0 +1,58 @@
+/*! 
+** @file	PointwiseLut.cpp
+** 
+** @brief	Per-channel lookup table built from pointwise filter stages
+**  
+*/  
+ 
+/*--------------------------------------------------------------------------- 
+** Includes 
+*/
+#include "PointwiseLut.h"
+ 
+/*--------------------------------------------------------------------------- 
+** Defines and Macros 
+*/
+ 
+/*--------------------------------------------------------------------------- 
+** Typedefs 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Local function prototypes 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Data 
+*/
+
+PointwiseLut::PointwiseLut() {
+	reset();
+}
+
+void PointwiseLut::reset() {
+	for (int i = 0; i < 256; ++i) {
+		m_table[i] = qRgb(i, i, i);
+	}
+}
+
+void PointwiseLut::append(
+	const QtImageFilter& stage
+) {
+	// The table is a 256 pixel row whose pixel i has the value i in every
+	// channel, which is all a channel lookup can tell apart
+	stage.processRow(m_table, 0, 0, 256, QSize(256, 1), NULL);
+}
+
+void PointwiseLut::process_row(
+	QRgb* row,
+	int left,
+	int right
+) const {
+	for (int x = left; x < right; x++) {
+		QRgb rgb = row[x];
+		row[x] = qRgb(qRed(m_table[qRed(rgb)]),
+					  qGreen(m_table[qGreen(rgb)]),
+					  qBlue(m_table[qBlue(rgb)]));
+	}
+}
@@ -0,0 +1,58 @@
+/*!
+** @file	PointwiseLut.h
+** 
+** @brief	Per-channel lookup table built from pointwise filter stages
+**  
+*/  
+#ifndef __pointwiselut__h
+#define __pointwiselut__h
+ 
+/*--------------------------------------------------------------------------- 
+** Includes 
+*/
+#include <QRgb>
+#include <QtImageFilter>
+ 
+/*--------------------------------------------------------------------------- 
+** Defines and Macros 
+*/
+ 
+/*--------------------------------------------------------------------------- 
+** Typedefs 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Local function prototypes 
+*/ 
+ 
+/*--------------------------------------------------------------------------- 
+** Data 
+*/
+
+// A run of filters whose output channels each depend only on the same input
+// channel (Levels, Contrast, ColourLookup) collapsed into one 3x256 table.
+//
+// Entry i of the table holds the red, green and blue results for an input
+// value of i in each channel. Appending a stage runs that stage's own row
+// kernel over the table, so the composed result is exactly what running the
+// stages one after another would produce.
+class PointwiseLut {
+public:
+	// Identity table
+	PointwiseLut();
+
+	// Reset to the identity table
+	void reset();
+
+	// Apply a filter whose kind() is ChannelLookupFilter after the stages
+	// already in the table
+	void append(const QtImageFilter& stage);
+
+	// Apply the table to pixels [left, right) of one scanline in place
+	void process_row(QRgb* row, int left, int right) const;
+
+private:
+	QRgb	m_table[256];
+};
+
+#endif
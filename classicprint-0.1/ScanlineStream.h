@@ -0,0 +1,102 @@
+/*!
+** @file	ScanlineStream.h
+**
+** @brief	Sources and destinations of photos read and written one scanline
+**			at a time
+**
+*/
+#ifndef __scanlinestream__h
+#define __scanlinestream__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QSize>
+#include <QRgb>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Photo decoded from top to bottom, one scanline at a time
+*/
+class ScanlineReader {
+public:
+    virtual ~ScanlineReader() {
+    }
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the size of the photo
+    **
+    ** @return  Size. Empty if the photo can not be read
+    */
+    virtual QSize size() const = 0;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Read the next scanline
+    **
+    ** @param[out] row          On return contains the scanline as opaque
+    **                          32-bit pixels
+    **
+    ** @return True/False
+    */
+    virtual bool readRow(QRgb* row) = 0;
+};
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Photo encoded from top to bottom, one scanline at a time
+*/
+class ScanlineWriter {
+public:
+    virtual ~ScanlineWriter() {
+    }
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Start writing a photo
+    **
+    ** @param[In] size          Size of the photo
+    **
+    ** @return True/False
+    */
+    virtual bool begin(const QSize& size) = 0;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Write the next scanline
+    **
+    ** @param[In] row           Scanline of 32-bit pixels
+    **
+    ** @return True/False
+    */
+    virtual bool writeRow(const QRgb* row) = 0;
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Finish the photo once every scanline has been written. A
+    **          photo that is never finished is discarded
+    **
+    ** @return True/False
+    */
+    virtual bool finish() = 0;
+};
+
+
+#endif
@@ -0,0 +1,38 @@
+/*!
+** @file	ScanlineWindow.h
+**
+** @brief	Read only view of the scanlines of an image that may only be
+**			partly in memory
+**
+*/
+#ifndef __scanlinewindow__h
+#define __scanlinewindow__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QtImageFilter>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+// Scanlines of a 32-bit image, kept in a buffer used as a ring so that a
+// photo can be streamed through the effects a band of rows at a time. The
+// image filters library defines it so that any filter can read its input
+// rows through it
+typedef QtScanlineWindow ScanlineWindow;
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+#endif
@@ -0,0 +1,108 @@
+/*!
+** @file	StageCache.cpp
+**
+** @brief	Memory capped cache of the intermediate images of a render
+**
+*/
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include "StageCache.h"
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Constructor
+**
+** @param[In] limit         Most kilobytes of images to keep
+**
+*/
+StageCache::StageCache(int limit)
+    : m_images(qMax(0, limit)) {
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Set the most memory kept in images
+**
+** @param[In] limit         Limit in kilobytes. 0 keeps no images
+*/
+void StageCache::setLimit(int limit) {
+    QMutexLocker    locker(&m_lock);
+    m_images.setMaxCost(qMax(0, limit));
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Get the most memory kept in images
+**
+** @return  Limit in kilobytes
+*/
+int StageCache::limit() {
+    QMutexLocker    locker(&m_lock);
+    return m_images.maxCost();
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Look up the output of a stage
+**
+** @param[In] key           Key of the stage
+** @param[out] image        On return contains the image if it was found
+**
+** @return  True/False
+*/
+bool StageCache::find(const QString& key, QImage& image) {
+    QMutexLocker    locker(&m_lock);
+    QImage*         cached = m_images.object(key);
+    if (!cached) {
+        return false;
+    }
+    // A shallow copy; the cached image is never written to
+    image = *cached;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Keep the output of a stage. Images larger than the limit are
+**          not kept
+**
+** @param[In] key           Key of the stage
+** @param[In] image         Output of the stage. It must not be changed
+**                          afterwards
+*/
+void StageCache::insert(const QString& key, const QImage& image) {
+    if (key.isEmpty() || image.isNull()) {
+        return;
+    }
+    QMutexLocker    locker(&m_lock);
+    // QCache deletes the copy itself if it is over the limit
+    m_images.insert(key, new QImage(image), qMax(1, image.byteCount() / 1024));
+}
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Drop all the images
+**
+*/
+void StageCache::clear() {
+    QMutexLocker    locker(&m_lock);
+    m_images.clear();
+}
@@ -0,0 +1,115 @@
+/*!
+** @file	StageCache.h
+**
+** @brief	Memory capped cache of the intermediate images of a render
+**
+*/
+#ifndef __stagecache__h
+#define __stagecache__h
+
+/*---------------------------------------------------------------------------
+** Includes
+*/
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+/*---------------------------------------------------------------------------
+** Defines and Macros
+*/
+
+// Default limit in kilobytes of the images kept
+#define STAGECACHE_DEFAULT_LIMIT    (16 * 1024)
+
+/*---------------------------------------------------------------------------
+** Typedefs
+*/
+
+/*---------------------------------------------------------------------------
+** Local function prototypes
+*/
+
+/*---------------------------------------------------------------------------
+** Data
+*/
+
+//---------------------------------------------------------------------------
+/*!
+** @brief   Cache of the output of each stage of a render.
+**
+** Each image is keyed by the source photo and the settings of the stage
+** that made it and of every stage before it. When a setting changes only
+** the stages from that one on have a new key, so a render can start from
+** the output of the last stage that did not change.
+**
+** Only up to a limit of memory is kept; the least recently used images
+** beyond it are dropped. The cache may be used from several threads at once.
+*/
+class StageCache {
+public:
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Constructor
+    **
+    ** @param[In] limit         Most kilobytes of images to keep
+    **
+    */
+    StageCache(int limit = STAGECACHE_DEFAULT_LIMIT);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Set the most memory kept in images
+    **
+    ** @param[In] limit         Limit in kilobytes. 0 keeps no images
+    */
+    void    setLimit(int limit);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Get the most memory kept in images
+    **
+    ** @return  Limit in kilobytes
+    */
+    int     limit();
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Look up the output of a stage
+    **
+    ** @param[In] key           Key of the stage
+    ** @param[out] image        On return contains the image if it was found
+    **
+    ** @return  True/False
+    */
+    bool    find(const QString& key, QImage& image);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Keep the output of a stage. Images larger than the limit are
+    **          not kept
+    **
+    ** @param[In] key           Key of the stage
+    ** @param[In] image         Output of the stage. It must not be changed
+    **                          afterwards
+    */
+    void    insert(const QString& key, const QImage& image);
+
+    //---------------------------------------------------------------------------
+    /*!
+    ** @brief   Drop all the images
+    **
+    */
+    void    clear();
+
+private:
+    Q_DISABLE_COPY(StageCache)
+
+    QMutex                      m_lock;
+
+    // Images by key. The cost is the size in kilobytes
+    QCache<QString, QImage>     m_images;
+};
+
+
+#endif
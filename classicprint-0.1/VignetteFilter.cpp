@@ -9,9 +9,15 @@
 ** Includes 
 */
 #include "VignetteFilter.h"
+#include "DefocusBlur.h"
 #include <math.h>
 #include "utils.h"
 #include <stdint.h>
+#include <string.h>
+#include <QList>
+#include <QMutex>
+#include <QVector>
+#include <QVarLengthArray>
  
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
@@ -20,16 +26,65 @@
 /*--------------------------------------------------------------------------- 
 ** Typedefs 
 */ 
+
+// Vignetted value of every input colour at every whole-pixel distance from
+// the centre. Once any blur has been mixed in, the vignette only depends on
+// those two, so (image_diag_dist_to_centre + 1) rows of 256 cover an image
+class VignetteTable : public QtImageFilterRowState {
+public:
+	int				image_diag_dist_to_centre;
+	int				vignette_radius;
+	int				vignette_amount_percent;
+	int				dodge_percent;
+	QVector<uchar>	colours;
+};
  
 /*--------------------------------------------------------------------------- 
 ** Local function prototypes 
 */ 
+static void delete_table(const VignetteTable* table);
+static QSharedPointer<const VignetteTable> find_table(int image_diag_dist_to_centre, int vignette_radius,
+													  int vignette_amount_percent, int dodge_percent);
  
 /*--------------------------------------------------------------------------- 
 ** Data 
 */
-static const int matrix[9] = { 1, 2, 1, 2, 2, 2, 1, 2, 1 };
-static const int normalise = 1 + 2 + 1 + 2 + 2 + 2 + 1 + 2 + 1;
+// Recently used gain tables, most recent first. Shared by all filters so
+// re-rendering with the same settings does not rebuild the table. Previews,
+// drafts and every level of the tiles each have their own size, so tables
+// are kept up to a number of bytes rather than a number of tables
+static QMutex table_lock;
+static QList<QSharedPointer<const VignetteTable> > tables;
+static const int max_table_bytes = 4 * 1024 * 1024;
+
+static void
+delete_table(
+	const VignetteTable* table
+) {
+	delete table;
+}
+
+// Find a table and make it the most recent. table_lock must be held
+static QSharedPointer<const VignetteTable>
+find_table(
+	int image_diag_dist_to_centre,
+	int vignette_radius,
+	int vignette_amount_percent,
+	int dodge_percent
+) {
+	for (int i = 0; i < tables.size(); ++i) {
+		const VignetteTable* table = tables[i].data();
+		if ((table->image_diag_dist_to_centre == image_diag_dist_to_centre) &&
+			(table->vignette_radius == vignette_radius) &&
+			(table->vignette_amount_percent == vignette_amount_percent) &&
+			(table->dodge_percent == dodge_percent)) {
+			QSharedPointer<const VignetteTable> found = tables.takeAt(i);
+			tables.prepend(found);
+			return found;
+		}
+	}
+	return QSharedPointer<const VignetteTable>();
+}
 
 QtImageFilter*
 register_vignette_filter() {
@@ -41,6 +96,7 @@ VignetteFilter::VignetteFilter() {
     m_vignette_amount_percent = 80.0;
     m_dodge_percent           = 50.0;
     m_blur                    = false;
+    m_blur_radius             = 1;
 }
 
 int
@@ -66,6 +122,19 @@ VignetteFilter::process_colour(
         colour = scale(dist_centre, vignette_radius, image_diag_dist_to_centre, colour, cnv_pixel);
     }
 
+	return vignette_colour(colour, dist_centre, vignette_radius, vignette_amount_percent,
+						   dodge_percent, image_diag_dist_to_centre);
+}
+
+int
+VignetteFilter::vignette_colour(
+		int		colour,
+		int		dist_centre,
+		int		vignette_radius,
+		int		vignette_amount_percent,
+		int		dodge_percent,
+		int		image_diag_dist_to_centre
+) const {
     // Scale the colour based on distance from radius
     if (dist_centre > vignette_radius) {
 		colour -= qBound(0, scale(dist_centre, vignette_radius,
@@ -98,6 +167,120 @@ VignetteFilter::process_colour(
     return colour;
 }
 
+QSharedPointer<const VignetteTable>
+VignetteFilter::gain_table(
+	const QSize &size
+) const {
+	int image_diag_dist_to_centre = (int)sqrt(sq(size.width()) + sq(size.height())) / 2;
+	int vignette_radius = scale((int)m_vignette_radius_percent, 0, 100, 0, image_diag_dist_to_centre);
+	int vignette_amount_percent = (int)m_vignette_amount_percent;
+	int dodge_percent = (int)m_dodge_percent;
+
+	{
+		QMutexLocker locker(&table_lock);
+		QSharedPointer<const VignetteTable> found = find_table(image_diag_dist_to_centre, vignette_radius,
+																vignette_amount_percent, dodge_percent);
+		if (found) {
+			return found;
+		}
+	}
+
+	// Built without the lock held so renders of other sizes are not held up
+	VignetteTable* table = new VignetteTable;
+	table->image_diag_dist_to_centre = image_diag_dist_to_centre;
+	table->vignette_radius = vignette_radius;
+	table->vignette_amount_percent = vignette_amount_percent;
+	table->dodge_percent = dodge_percent;
+	table->colours.resize((image_diag_dist_to_centre + 1) * 256);
+
+	uchar* colours = table->colours.data();
+	for (int dist = 0; dist <= image_diag_dist_to_centre; ++dist) {
+		for (int colour = 0; colour < 256; ++colour) {
+			int vignetted = vignette_colour(colour, dist, vignette_radius, vignette_amount_percent,
+											dodge_percent, image_diag_dist_to_centre);
+			*colours++ = (uchar)qBound(0, vignetted, 255);
+		}
+	}
+
+	// Callers only see a declaration of the table, so it is deleted here
+	QSharedPointer<const VignetteTable> result(table, delete_table);
+
+	QMutexLocker locker(&table_lock);
+	// Another render may have built the same table meanwhile
+	QSharedPointer<const VignetteTable> found = find_table(image_diag_dist_to_centre, vignette_radius,
+															vignette_amount_percent, dodge_percent);
+	if (found) {
+		return found;
+	}
+	tables.prepend(result);
+
+	// Drop the least recently used tables over the limit. Renders still
+	// using one keep it until they finish
+	int bytes = 0;
+	for (int i = 0; i < tables.size(); ) {
+		bytes += tables[i]->colours.size();
+		if ((i > 0) && (bytes > max_table_bytes)) {
+			bytes -= tables[i]->colours.size();
+			tables.removeAt(i);
+		}
+		else {
+			++i;
+		}
+	}
+	return result;
+}
+
+QtImageFilter::FilterKind
+VignetteFilter::kind(
+) const {
+	return m_blur ? NeighbourhoodFilter : PointwiseFilter;
+}
+
+QSharedPointer<const QtImageFilterRowState>
+VignetteFilter::prepareRows(
+	const QSize &size
+) const {
+	return gain_table(size);
+}
+
+void
+VignetteFilter::processRow(
+	QRgb* row,
+	int y,
+	int left,
+	int right,
+	const QSize& size,
+	const QtImageFilterRowState* state
+) const {
+	// The row is its own input, which is all there is to read without the blur
+	ScanlineWindow img((const uchar*)row, 0, 1, size.width(), size.height());
+	process_row(img, y, row, left, right, static_cast<const VignetteTable*>(state));
+}
+
+int
+VignetteFilter::contextRows(
+) const {
+	return m_blur ? m_blur_radius : 0;
+}
+
+bool
+VignetteFilter::applyToRows(
+	const QtScanlineWindow& input,
+	int top,
+	int bottom,
+	int left,
+	int right,
+	uchar* output,
+	int bytesPerLine,
+	const QtImageFilterRowState* state
+) const {
+	for (int y = top; y < bottom; y++) {
+		process_row(input, y, (QRgb*)(output + (y - top) * bytesPerLine), left, right,
+					static_cast<const VignetteTable*>(state));
+	}
+	return true;
+}
+
 QImage VignetteFilter::apply(
 	const QImage &img,
 	const QRect& clipRect
@@ -110,69 +293,206 @@ QImage VignetteFilter::apply(
 	const QRect& clipRect,
 	void (*progress)(int, void*), void* context
 ) const {
-    int x;
+	QImage resultImg = img;
+	applyInPlace(resultImg, clipRect, progress, context);
+	return resultImg;
+}
+
+bool VignetteFilter::applyInPlace(
+	QImage &img,
+	const QRect& clipRect
+) const {
+	return applyInPlace(img, clipRect, NULL, NULL);
+}
+
+bool VignetteFilter::applyInPlace(
+	QImage &img,
+	const QRect& clipRect,
+	void (*progress)(int, void*), void* context
+) const {
     int y;
     int top = 0;
     int bottom = img.height();
     int left = 0;
     int right = img.width();
-    int centre_x = right / 2;
-    int centre_y = bottom / 2;
 	int percent = -1;
 
     if (!clipRect.isNull()) {
         // If we have a cliprect, set our coordinates to our cliprect
         // and make sure it is within the boundaries of the image
         top = qMax(top, clipRect.top());
-        bottom = qMin(bottom, clipRect.bottom());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
         left = qMax(left, clipRect.left());
-        right = qMin(right, clipRect.right());
+        right = qMin(right, clipRect.right() + 1);
     }
 
     QImage::Format fmt = img.format();
-    QImage resultImg = img.convertToFormat(QImage::Format_ARGB32);
+    if ((fmt != QImage::Format_RGB32) && (fmt != QImage::Format_ARGB32)) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    }
+	QSharedPointer<const VignetteTable> table = gain_table(img.size());
 
-	int image_diag_dist_to_centre = (int)sqrt(sq(img.width()) + sq(img.height())) / 2;
-	int vignette_radius = scale((int)m_vignette_radius_percent, 0, 100, 0, image_diag_dist_to_centre);
+	// Detach before taking a view of the pixels
+	img.bits();
 
-	uchar* bits = resultImg.bits();
+	// The blur reads the unmodified rows around each one. Keep copies of
+	// those in a ring, read ahead of the rows being overwritten
+	int radius = contextRows();
+	QImage original;
+	int next = qMax(0, top - radius);
+	if (radius > 0) {
+		original = QImage(img.width(), qMin(img.height(), radius * 2 + 1), img.format());
+	}
+	ScanlineWindow source = (radius > 0) ?
+		ScanlineWindow(original.bits(), original.bytesPerLine(), original.height(),
+					   img.width(), img.height()) :
+		ScanlineWindow(img);
 
 	for (y = top; y < bottom; y++) {
-		int this_percent = y * 100 / bottom;
+		int this_percent = (y - top) * 100 / (bottom - top);
 		if (progress && (percent != this_percent)) {
 			percent = this_percent;
 			progress(percent, context);
 		}
-        for (x = left; x < right; x++) {
-			// Read the pixel data
-			QRgb rgb = ((uint32_t*)bits)[x];
-			QRgb cnv_pixel = rgb;
+		if (radius > 0) {
+			for (; next <= qMin(y + radius, img.height() - 1); next++) {
+				memcpy(original.scanLine(next % original.height()),
+					   img.constScanLine(next), img.width() * sizeof(QRgb));
+			}
+		}
+		process_row(source, y, (QRgb*)img.scanLine(y), left, right, table.data());
+	}
+
+    if (img.format() != fmt) {
+        img = img.convertToFormat(fmt);
+    }
+    return true;
+}
+
+void VignetteFilter::process_row(
+	const ScanlineWindow &img,
+	int y,
+	QRgb* row,
+	int left,
+	int right,
+	const VignetteTable* table
+) const {
+	int centre_x = img.width() / 2;
+	int centre_y = img.height() / 2;
+	int image_diag_dist_to_centre = (int)sqrt(sq(img.width()) + sq(img.height())) / 2;
+	int vignette_radius = scale((int)m_vignette_radius_percent, 0, 100, 0, image_diag_dist_to_centre);
+
+	const uint32_t* src = (const uint32_t*)img.row(y);
+
+	if (!table ||
+		(table->image_diag_dist_to_centre != image_diag_dist_to_centre) ||
+		(table->vignette_radius != vignette_radius) ||
+		(table->vignette_amount_percent != (int)m_vignette_amount_percent) ||
+		(table->dodge_percent != (int)m_dodge_percent)) {
+		// No table for this image, evaluate the vignette for every pixel
+		QVarLengthArray<QRgb, 1024> blurred(m_blur ? right - left : 0);
+		if (m_blur) {
+			defocus_row(img, y, m_blur_radius, left, right, blurred.data());
+		}
 
-            // If blurring is to be applied then convolve the pixel
-            if (m_blur) {
-                cnv_pixel = convolvePixel(resultImg, x, y, matrix, 3, 3, normalise, 0);
-            }
+		for (int x = left; x < right; x++) {
+			// Read the pixel data
+			QRgb rgb = src[x];
+			QRgb cnv_pixel = m_blur ? blurred[x - left] : rgb;
 
 			int red = process_colour(qRed(rgb), qRed(cnv_pixel), x, y, centre_x, centre_y, vignette_radius, m_vignette_amount_percent,
-                                        m_dodge_percent, image_diag_dist_to_centre);
+										m_dodge_percent, image_diag_dist_to_centre);
 			int green = process_colour(qGreen(rgb), qGreen(cnv_pixel), x, y, centre_x, centre_y, vignette_radius, m_vignette_amount_percent,
-                                        m_dodge_percent, image_diag_dist_to_centre);
+										m_dodge_percent, image_diag_dist_to_centre);
 			int blue = process_colour(qBlue(rgb), qBlue(cnv_pixel), x, y, centre_x, centre_y, vignette_radius, m_vignette_amount_percent,
-                                        m_dodge_percent, image_diag_dist_to_centre);
+										m_dodge_percent, image_diag_dist_to_centre);
 
 			red = qBound(0, red, 255);
 			green = qBound(0, green, 255);
 			blue = qBound(0, blue, 255);
 
-			((uint32_t*)bits)[x] = qRgb(red, green, blue);
+			row[x] = qRgb(red, green, blue);
 		}
-		bits += resultImg.bytesPerLine();
+		return;
+	}
+
+	// Pick the loop with or without the blur once rather than per pixel
+	if (m_blur) {
+		process_row_table<true>(img, y, row, left, right, table);
+	}
+	else {
+		process_row_table<false>(img, y, row, left, right, table);
+	}
+}
+
+template <bool Blur>
+void VignetteFilter::process_row_table(
+	const ScanlineWindow &img,
+	int y,
+	QRgb* row,
+	int left,
+	int right,
+	const VignetteTable* table
+) const {
+	if (left >= right) {
+		return;
+	}
+
+	int centre_x = img.width() / 2;
+	int centre_y = img.height() / 2;
+	int image_diag_dist_to_centre = table->image_diag_dist_to_centre;
+	int vignette_radius = table->vignette_radius;
+	const uint32_t* src = (const uint32_t*)img.row(y);
+
+	int y_sq = sq(y - centre_y);
+
+	// Only pixels outside the vignette radius use the blur, and those are the
+	// ones with dx * dx + dy * dy >= (radius + 1)^2. Blur the parts of the row
+	// either side of that circle
+	QVarLengthArray<QRgb, 1024> blurred(Blur ? right - left : 0);
+	if (Blur) {
+		int inside = sq(vignette_radius + 1) - y_sq;
+		int half_chord = -1;
+		if (inside > 0) {
+			half_chord = (int)sqrt(inside - 1);
+		}
+		int inner_left = qBound(left, centre_x - half_chord, right);
+		int inner_right = qMax(inner_left, qBound(left, centre_x + half_chord + 1, right));
+		defocus_row(img, y, m_blur_radius, left, inner_left, blurred.data());
+		defocus_row(img, y, m_blur_radius, inner_right, right, blurred.data() + (inner_right - left));
+	}
+
+	// The distance from the centre changes by at most one whole pixel between
+	// neighbours, so it is tracked along the row instead of taking a square
+	// root per pixel
+	int dist_centre = (int)sqrt(sq(left - centre_x) + y_sq);
+
+	for (int x = left; x < right; x++) {
+		int dist_sq = sq(x - centre_x) + y_sq;
+		while (sq(dist_centre + 1) <= dist_sq) {
+			dist_centre++;
+		}
+		while (sq(dist_centre) > dist_sq) {
+			dist_centre--;
+		}
+
+		// Read the pixel data
+		QRgb rgb = src[x];
+		int red = qRed(rgb);
+		int green = qGreen(rgb);
+		int blue = qBlue(rgb);
+
+		// Mix in the blurred pixel further out than the vignette radius
+		if (Blur && (dist_centre > vignette_radius)) {
+			QRgb cnv_pixel = blurred[x - left];
+			red = scale(dist_centre, vignette_radius, image_diag_dist_to_centre, red, qRed(cnv_pixel));
+			green = scale(dist_centre, vignette_radius, image_diag_dist_to_centre, green, qGreen(cnv_pixel));
+			blue = scale(dist_centre, vignette_radius, image_diag_dist_to_centre, blue, qBlue(cnv_pixel));
+		}
+
+		const uchar* colours = table->colours.constData() + dist_centre * 256;
+		row[x] = qRgb(colours[red], colours[green], colours[blue]);
 	}
-    
-    if (resultImg.format() != fmt) {
-        resultImg = resultImg.convertToFormat(fmt);
-    }
-    return resultImg;
 }
 
 QString
@@ -197,6 +517,9 @@ VignetteFilter::option(
     else if (filteroption == Blur) {
         return QVariant(m_blur);
     }
+    else if (filteroption == BlurRadius) {
+        return QVariant(m_blur_radius);
+    }
     return QVariant();
 }
 
@@ -217,6 +540,9 @@ VignetteFilter::setOption(
     else if (filteroption == Blur) {
         m_blur = value.toBool();
     }
+    else if (filteroption == BlurRadius) {
+        m_blur_radius = qMax(1, value.toInt());
+    }
     return true;
 }
 	
@@ -227,7 +553,8 @@ VignetteFilter::supportsOption(
         if ((option == VignetteRadiusPercent) ||
             (option == VignetteAmountPercent) ||
             (option == DodgePercent) ||
-            (option == Blur)) {
+            (option == Blur) ||
+            (option == BlurRadius)) {
 		return true;
 	}
 	return false;
@@ -11,6 +11,8 @@
 ** Includes 
 */
 #include <QtImageFilter>
+#include <QSharedPointer>
+#include "ScanlineWindow.h"
  
 /*--------------------------------------------------------------------------- 
 ** Defines and Macros 
@@ -20,6 +22,7 @@
 /*--------------------------------------------------------------------------- 
 ** Typedefs 
 */ 
+class VignetteTable;
  
 /*--------------------------------------------------------------------------- 
 ** Local function prototypes 
@@ -37,7 +40,8 @@ public:
             VignetteRadiusPercent = UserOption,
             VignetteAmountPercent,
             DodgePercent,
-            Blur
+            Blur,
+            BlurRadius
     };
         VignetteFilter();
 
@@ -45,6 +49,34 @@ public:
 	virtual QImage apply(const QImage &img, const QRect& clipRect,
 						 void (*progress)(int, void*), void* context) const;
 
+	virtual bool applyInPlace(QImage &img, const QRect& clipRect = QRect()) const;
+	bool applyInPlace(QImage &img, const QRect& clipRect,
+					  void (*progress)(int, void*), void* context) const;
+
+	// Pointwise without the blur, which reads the pixels around each one
+	virtual FilterKind kind() const;
+
+	// Build (or reuse) the gain table for images of this size so that
+	// process_row does one lookup per channel instead of evaluating the
+	// vignette curve for every pixel. The filter itself is not changed, so
+	// one instance can render images of different sizes at once
+	virtual QSharedPointer<const QtImageFilterRowState> prepareRows(const QSize &size) const;
+
+	virtual void processRow(QRgb* row, int y, int left, int right, const QSize& size,
+							const QtImageFilterRowState* state) const;
+
+	// Number of scanlines either side of a row that the blur reads
+	virtual int contextRows() const;
+
+	virtual bool applyToRows(const QtScanlineWindow& input, int top, int bottom, int left, int right,
+							 uchar* output, int bytesPerLine, const QtImageFilterRowState* state) const;
+
+	// Process one scanline of img into row with the table from prepareRows().
+	// Neighbouring pixels for the defocus blur are read from img, which may
+	// be the same buffer as row
+	void process_row(const ScanlineWindow &img, int y, QRgb* row, int left, int right,
+					 const VignetteTable* table) const;
+
 	virtual QString name() const;
 
 	virtual QVariant option(int filteroption) const;
@@ -70,12 +102,32 @@ private:
 			int		image_diag_dist_to_centre
         ) const;
 
+		int
+		vignette_colour(
+			int		colour,
+			int		dist_centre,
+			int		vignette_radius,
+			int		vignette_amount_percent,
+			int		dodge_percent,
+			int		image_diag_dist_to_centre
+		) const;
+
+		QSharedPointer<const VignetteTable>
+		gain_table(const QSize &size) const;
+
+		// process_row using the gain table, with the blur fixed on or off
+		template <bool Blur>
+		void
+		process_row_table(const ScanlineWindow &img, int y, QRgb* row, int left, int right,
+						  const VignetteTable* table) const;
+
 
 private:
 		double			m_vignette_radius_percent;
         double          m_vignette_amount_percent;
         double          m_dodge_percent;
         bool            m_blur;
+        int             m_blur_radius;
 };
 
 #endif
@@ -4,6 +4,7 @@
 
 #include "ClassicPrint.h"
 #include "ClassicPrintProvider.h"
+#include "ClassicPrintTileProvider.h"
 #include "ClassicPrintDeclarative.h"
 
 #include "custom_listdir.h"
@@ -20,6 +21,7 @@ int main(int argc, char *argv[])
     QDeclarativeView view;
 
     ClassicPrintProvider::addToView(&view);
+    ClassicPrintTileProvider::addToView(&view);
 
 #if defined(CLASSICPRINTQML_DESKTOP)
     QDir dcim("/home/thp/Pictures/Webcam/");
@@ -5,6 +5,9 @@ CONFIG += debug
 
 QT += declarative xml
 
+# Streaming JPEG export
+LIBS += -ljpeg
+
 OBJECTS_DIR = build
 MOC_DIR = build
 RCC_DIR = build
@@ -76,7 +76,7 @@ PageStackWindow {
 
             Image {
                 id: displayImage
-                visible: !classicPrint.saving
+                visible: !classicPrint.saving && !zoomView.zoomed
                 asynchronous: true
                 property string filePath: ''
 
@@ -90,7 +90,8 @@ PageStackWindow {
 
                 source: {
                     if (filePath !== '') {
-                        'image://classicPrint/' + filePath + '#' + classicPrint.sequence;
+                        'image://classicPrint/' + filePath + '#' + classicPrint.sequence +
+                            (classicPrint.draft ? 'd' : '');
                     } else {
                         ''
                     }
@@ -98,14 +99,132 @@ PageStackWindow {
 
                 sourceSize.width: width
                 sourceSize.height: height
+
+                // A new photo starts fitted to the screen
+                onFilePathChanged: zoomView.zoom = 0
             }
 
-            MouseArea {
+            // Zoomed preview, drawn from tiles of the level of the tile pyramid
+            // closest to the zoom so only the part in view is rendered
+            Flickable {
+                id: zoomView
                 anchors.fill: parent
-                onClicked: {
-                    lensPane.state = 'down';
-                    filmPane.state = 'down';
-                    processingPane.state = 'down';
+                visible: !classicPrint.saving
+                interactive: zoomed
+                contentWidth: Math.max(width, fullSize.width * zoom)
+                contentHeight: Math.max(height, fullSize.height * zoom)
+
+                // Screen pixels per pixel of the processed photo at full size.
+                // Anything below fitZoom shows the fitted preview
+                property real zoom: 0
+                property real maxZoom: 2
+                property real fitZoom: (fullSize.width > 0 && fullSize.height > 0) ?
+                                           Math.min(width / fullSize.width, height / fullSize.height) : 1
+                property bool zoomed: zoom > fitZoom
+
+                property variant fullSize: {
+                    classicPrint.sequence;
+                    classicPrint.tiledSize(displayImage.filePath, 0)
+                }
+                property int levels: (displayImage.filePath !== '') ?
+                                         classicPrint.tileLevels(displayImage.filePath) : 0
+                // Coarsest level that still has a pixel per screen pixel
+                property int level: Math.max(0, Math.min(levels - 1,
+                                                         Math.floor(-Math.log(Math.max(zoom, fitZoom)) / Math.LN2)))
+                property variant levelSize: {
+                    classicPrint.sequence;
+                    classicPrint.tiledSize(displayImage.filePath, level)
+                }
+
+                // Tiles are only rendered for settings that have settled
+                property int tileSequence: 0
+
+                Component.onCompleted: tileSequence = classicPrint.sequence
+
+                Connections {
+                    target: classicPrint
+                    onSequenceChanged: {
+                        if (!classicPrint.draft) {
+                            zoomView.tileSequence = classicPrint.sequence;
+                        }
+                    }
+                }
+
+                // Zoom, keeping the point of the photo at viewX, viewY in place
+                function zoomTo(newZoom, viewX, viewY) {
+                    var current = Math.max(zoom, fitZoom);
+                    newZoom = Math.max(fitZoom, Math.min(maxZoom, newZoom));
+
+                    var photoX = (contentX + viewX - Math.max(0, (width - fullSize.width * current) / 2)) / current;
+                    var photoY = (contentY + viewY - Math.max(0, (height - fullSize.height * current) / 2)) / current;
+                    zoom = newZoom;
+                    contentX = Math.max(0, Math.min(contentWidth - width,
+                        photoX * newZoom + Math.max(0, (width - fullSize.width * newZoom) / 2) - viewX));
+                    contentY = Math.max(0, Math.min(contentHeight - height,
+                        photoY * newZoom + Math.max(0, (height - fullSize.height * newZoom) / 2) - viewY));
+                }
+
+                Item {
+                    id: tileLayer
+                    visible: zoomView.zoomed
+                    width: zoomView.levelSize.width
+                    height: zoomView.levelSize.height
+                    transformOrigin: Item.TopLeft
+                    scale: (width > 0) ? zoomView.fullSize.width * zoomView.zoom / width : 1
+
+                    // Centred while it is smaller than the view
+                    x: Math.max(0, (zoomView.width - width * scale) / 2)
+                    y: Math.max(0, (zoomView.height - height * scale) / 2)
+
+                    property int columns: Math.ceil(width / classicPrint.tileSize)
+                    property int rows: Math.ceil(height / classicPrint.tileSize)
+                    property real tileExtent: classicPrint.tileSize * scale
+
+                    Repeater {
+                        model: tileLayer.visible ? tileLayer.columns * tileLayer.rows : 0
+
+                        Image {
+                            property int column: index % tileLayer.columns
+                            property int row: Math.floor(index / tileLayer.columns)
+                            property real left: tileLayer.x + column * tileLayer.tileExtent
+                            property real top: tileLayer.y + row * tileLayer.tileExtent
+                            property bool inView: left < zoomView.contentX + zoomView.width &&
+                                                  left + tileLayer.tileExtent > zoomView.contentX &&
+                                                  top < zoomView.contentY + zoomView.height &&
+                                                  top + tileLayer.tileExtent > zoomView.contentY
+
+                            x: column * classicPrint.tileSize
+                            y: row * classicPrint.tileSize
+                            asynchronous: true
+                            source: inView ? 'image://classicPrintTile/' + displayImage.filePath + '#' +
+                                             zoomView.tileSequence + '@' + zoomView.level + ',' +
+                                             column + ',' + row : ''
+                        }
+                    }
+                }
+
+                PinchArea {
+                    width: zoomView.contentWidth
+                    height: zoomView.contentHeight
+                    property real startZoom: 1
+
+                    onPinchStarted: startZoom = Math.max(zoomView.zoom, zoomView.fitZoom)
+                    onPinchUpdated: zoomView.zoomTo(startZoom * pinch.scale,
+                                                    pinch.center.x - zoomView.contentX,
+                                                    pinch.center.y - zoomView.contentY)
+
+                    MouseArea {
+                        anchors.fill: parent
+                        onClicked: {
+                            lensPane.state = 'down';
+                            filmPane.state = 'down';
+                            processingPane.state = 'down';
+                        }
+                        // Toggle between the fitted preview and full size
+                        onDoubleClicked: zoomView.zoomTo(zoomView.zoomed ? zoomView.fitZoom : 1,
+                                                         mouse.x - zoomView.contentX,
+                                                         mouse.y - zoomView.contentY)
+                    }
                 }
             }
         }
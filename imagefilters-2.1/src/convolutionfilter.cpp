@@ -46,6 +46,8 @@
 
 #include "convolutionfilter.h"
 #include <QtGui/QImage>
+#include <QtCore/QVarLengthArray>
+#include <string.h>
 
 
 ConvolutionFilter::ConvolutionFilter()
@@ -167,7 +169,9 @@ bool ConvolutionFilter::supportsOption(int option) const
 
 QImage ConvolutionFilter::apply(const QImage &image, const QRect& clipRect /*= QRect()*/ ) const
 {
-    return convolve(image, clipRect);
+    QImage resultImg = image;
+    applyInPlace(resultImg, clipRect);
+    return resultImg;
 }
 
 bool ConvolutionFilter::setChannels(const QString &rgba)
@@ -260,7 +264,7 @@ ConvolutionFilter::~ConvolutionFilter()
 
 }
 
-QImage ConvolutionFilter::convolve(const QImage &img, const QRect& clipRect) const
+bool ConvolutionFilter::applyInPlace(QImage &img, const QRect& clipRect /*= QRect()*/ ) const
 {
     int top = 0;
     int bottom = img.height();
@@ -271,155 +275,559 @@ QImage ConvolutionFilter::convolve(const QImage &img, const QRect& clipRect) con
         // If we have a cliprect, set our coordinates to our cliprect
         // and make sure it is within the boundaries of the image
         top = qMax(top, clipRect.top());
-        bottom = qMin(bottom, clipRect.bottom());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
         left = qMax(left, clipRect.left());
-        right = qMin(right, clipRect.right());
+        right = qMin(right, clipRect.right() + 1);
     }
 
 
+    // RGB32 pixels read the same as ARGB32 ones, so they only need converting
+    // if the alpha channel is filtered
     QImage::Format fmt = img.format();
-    QImage resultImg = img.convertToFormat(QImage::Format_ARGB32);
+    if (fmt != QImage::Format_ARGB32 &&
+        (fmt != QImage::Format_RGB32 || (m_channels & ConvolutionFilter::Alpha))) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    }
+    if (img.isNull() || left >= right) {
+        return !img.isNull();
+    }
 
-    int x;
-    int y;
+    int width = img.width();
+    int height = img.height();
+    // Detach now, so scanLine() below writes to the pixels we read
+    img.bits();
+
+    QVector<QRgb> line(right - left);
+    RowFunction convolveRow = rowFunction();
+    QVarLengthArray<const QRgb *, 32> rows;
 
     for (int i = 0; i < m_kernels.count(); ++i) {
-        QImage normalizedImg = resultImg;
-        KernelMatrixData data = m_kernels[i];
-        QtConvolutionKernelMatrix kernel = data.matrix;
-        int divisor = data.divisor;
-        int bias = data.bias;
-
-        for (y = top; y < bottom; y++) {
-            for (x = left; x < right; x++) {
-                resultImg.setPixel( x, y, convolvePixelRGBA( normalizedImg, x, y, kernel.data(), 
-                                    kernel.rowCount(), kernel.columnCount(), divisor, bias) );
+        const KernelMatrixData &data = m_kernels.at(i);
+        const QtConvolutionKernelMatrix &kernel = data.matrix;
+        int kernelRows = kernel.rowCount();
+        int kernelColumns = kernel.columnCount();
+
+        // Each output pixel reads kernelColumns source rows, starting
+        // kernelRows / 2 rows above it. The rows above the one being written
+        // have already been filtered, so their original pixels are kept in a
+        // ring. With the wrap policy the last rows also read the first ones,
+        // which are kept as well.
+        int above = kernelRows / 2;
+        int below = qMax(0, kernelColumns - 1 - above);
+        int ringRows = above + below + 1;
+        if (ringRows * 2 + below >= height) {
+            ringRows = height;
+        }
+        QImage ring(width, ringRows, img.format());
+        QImage head;
+        if (m_borderPolicy == ConvolutionFilter::Wrap && ringRows < height && below > 0) {
+            head = img.copy(0, 0, width, below);
+        }
+
+        rows.resize(kernelColumns);
+        for (int y = top; y < bottom; y++) {
+            const QRgb *centre = (const QRgb *)img.constScanLine(y);
+            memcpy(ring.scanLine(y % ringRows), centre, width * sizeof(QRgb));
+
+            for (int j = 0; j < kernelColumns; j++) {
+                int srcpix_y = borderPixel(y - above + j, height);
+                if (srcpix_y < top || srcpix_y >= y) {
+                    rows[j] = (const QRgb *)img.constScanLine(srcpix_y);
+                } else if (srcpix_y > y - ringRows) {
+                    rows[j] = (const QRgb *)ring.constScanLine(srcpix_y % ringRows);
+                } else {
+                    rows[j] = (const QRgb *)head.constScanLine(srcpix_y);
+                }
             }
+
+            (this->*convolveRow)(rows.constData(), centre, width, left, right,
+                                 kernel.data(), kernelRows, kernelColumns,
+                                 data.divisor, data.bias, line.data());
+            memcpy((QRgb *)img.scanLine(y) + left, line.constData(), (right - left) * sizeof(QRgb));
         }
     }
-    if (resultImg.format() != fmt) {
-        resultImg = resultImg.convertToFormat(fmt);
+    if (img.format() != fmt) {
+        img = img.convertToFormat(fmt);
     }
-    return resultImg;
+    return true;
+}
+
+/*!
+    \internal
+
+    Returns the rows either side of the one being filtered that the
+    kernel reads. Only a single kernel is supported a range of rows at a
+    time, as each kernel reads the output of the one before, and not the
+    wrap border policy, which reads rows from the other end of the image.
+*/
+int ConvolutionFilter::contextRows() const
+{
+    if (m_kernels.count() != 1 || m_borderPolicy == ConvolutionFilter::Wrap) {
+        return -1;
+    }
+    const QtConvolutionKernelMatrix &kernel = m_kernels.at(0).matrix;
+    int above = kernel.rowCount() / 2;
+    int below = qMax(0, kernel.columnCount() - 1 - above);
+    return qMax(above, below);
+}
+
+/*!
+    \internal
+
+    Convolves pixels \a left to \a right - 1 of rows \a top to
+    \a bottom - 1 of the image in the \a input window into \a output.
+    Reads the same pixels as applyInPlace(), so the result is the same.
+*/
+bool ConvolutionFilter::applyToRows(const QtScanlineWindow &input, int top, int bottom,
+                                    int left, int right, uchar *output, int bytesPerLine,
+                                    const QtImageFilterRowState *state) const
+{
+    Q_UNUSED(state);
+    if (contextRows() < 0) {
+        return false;
+    }
+
+    const KernelMatrixData &data = m_kernels.at(0);
+    const QtConvolutionKernelMatrix &kernel = data.matrix;
+    int kernelRows = kernel.rowCount();
+    int kernelColumns = kernel.columnCount();
+    int above = kernelRows / 2;
+    int width = input.width();
+    int height = input.height();
+
+    RowFunction convolveRow = rowFunction();
+    QVarLengthArray<const QRgb *, 32> rows(kernelColumns);
+    for (int y = top; y < bottom; y++) {
+        for (int j = 0; j < kernelColumns; j++) {
+            rows[j] = input.row(borderPixel(y - above + j, height));
+        }
+        (this->*convolveRow)(rows.constData(), input.row(y), width, left, right,
+                             kernel.data(), kernelRows, kernelColumns,
+                             data.divisor, data.bias,
+                             (QRgb *)(output + (y - top) * bytesPerLine) + left);
+    }
+    return true;
+}
+
+int ConvolutionFilter::borderPixel(int i, int size) const
+{
+    if (i < 0) {
+        switch (m_borderPolicy) {
+            case ConvolutionFilter::Extend:
+            i = 0;
+            break;
+            case ConvolutionFilter::Mirror:
+            i = -i;
+            i %= size;
+            break;
+            case ConvolutionFilter::Wrap:
+            // In case of a large kernel and a small image, make sure we are in the bounds of the image coords
+            while (i < 0) {
+                i += size;
+            }
+            break;
+        }
+    }else if (i >= size) {
+        switch (m_borderPolicy) {
+            case ConvolutionFilter::Extend:
+            i = size - 1;
+            break;
+            case ConvolutionFilter::Mirror:
+            i %= size;
+            i = size - 1 - i;
+            break;
+            case ConvolutionFilter::Wrap:
+            i %= size;
+            break;
+        }
+    }
+    return i;
+}
+
+// Returns the source index of every position from -reach to size + reach - 1,
+// with the border policy applied, so that filters running along a row or
+// column need no bounds tests. Position i is at index i + reach.
+QVector<int> ConvolutionFilter::borderIndex(int size, int reach) const
+{
+    QVector<int> index(size + 2 * reach);
+    for (int i = -reach; i < size + reach; i++) {
+        index[i + reach] = borderPixel(i, size);
+    }
+    return index;
+}
+
+// Returns the bits of a pixel that belong to the filtered channels.
+QRgb ConvolutionFilter::channelMask() const
+{
+    QRgb mask = 0;
+    if (m_channels & ConvolutionFilter::Red)   mask |= qRgba(0xff, 0, 0, 0);
+    if (m_channels & ConvolutionFilter::Green) mask |= qRgba(0, 0xff, 0, 0);
+    if (m_channels & ConvolutionFilter::Blue)  mask |= qRgba(0, 0, 0xff, 0);
+    if (m_channels & ConvolutionFilter::Alpha) mask |= qRgba(0, 0, 0, 0xff);
+    return mask;
 }
 
-QRgb ConvolutionFilter::convolvePixelRGBA(const QImage &img, int x, int y, const int *kernelMatrix, int kernelRows, int kernelColumns, 
+static inline QRgb divideSums(int sumRed, int sumGreen, int sumBlue, int sumAlpha, int divisor)
+{
+    if (divisor) {
+        sumRed /= divisor;
+        sumGreen /= divisor;
+        sumBlue /= divisor;
+        sumAlpha /= divisor;
+    }
+    return qRgba(qBound(0, sumRed, 255), qBound(0, sumGreen, 255),
+                 qBound(0, sumBlue, 255), qBound(0, sumAlpha, 255));
+}
+
+/*!
+    \internal
+
+    Convolves the \a clipRect part of \a img with a centred 1-D kernel of
+    \a weights along the rows, then with the same kernel along the columns.
+    This is the same as convolving with the 2-D outer product of the kernel
+    with itself, for 2 * weights.size() rather than weights.size() squared
+    reads per pixel. Each pass is divided by \a divisor, or not at all if
+    it is 0.
+*/
+bool ConvolutionFilter::convolveSeparable(QImage &img, const QRect &clipRect,
+                                          const QVector<int> &weights, int divisor) const
+{
+    int top = 0;
+    int bottom = img.height();
+    int left = 0;
+    int right = img.width();
+
+    if (!clipRect.isNull()) {
+        // If we have a cliprect, set our coordinates to our cliprect
+        // and make sure it is within the boundaries of the image
+        top = qMax(top, clipRect.top());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
+        left = qMax(left, clipRect.left());
+        right = qMin(right, clipRect.right() + 1);
+    }
+
+    QImage::Format fmt = img.format();
+    if (fmt != QImage::Format_ARGB32 &&
+        (fmt != QImage::Format_RGB32 || (m_channels & ConvolutionFilter::Alpha))) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    }
+    if (img.isNull() || left >= right || top >= bottom || weights.isEmpty()) {
+        return !img.isNull();
+    }
+
+    int width = img.width();
+    int height = img.height();
+    int taps = weights.size();
+    int reach = taps / 2;
+    const int *weight = weights.constData();
+    QRgb mask = channelMask();
+    QVector<int> columns = borderIndex(width, reach);
+    QVector<int> rows = borderIndex(height, reach);
+    // Detach now, so scanLine() below writes to the pixels we read
+    img.bits();
+
+    // Filter the rows that the column pass reads, only across the clip
+    QVector<bool> needed(height, false);
+    for (int y = top; y < bottom; y++) {
+        for (int k = 0; k < taps; k++) {
+            needed[rows.at(y + k)] = true;
+        }
+    }
+    int span = right - left;
+    QImage scratch(span, height, QImage::Format_ARGB32);
+    if (scratch.isNull()) {
+        return false;
+    }
+    for (int y = 0; y < height; y++) {
+        if (!needed.at(y)) {
+            continue;
+        }
+        const QRgb *src = (const QRgb *)img.constScanLine(y);
+        QRgb *dst = (QRgb *)scratch.scanLine(y);
+        for (int x = left; x < right; x++) {
+            const int *index = columns.constData() + x;
+            int sumRed = 0, sumGreen = 0, sumBlue = 0, sumAlpha = 0;
+            for (int k = 0; k < taps; k++) {
+                QRgb rgb = src[index[k]];
+                sumRed   += qRed(rgb)   * weight[k];
+                sumGreen += qGreen(rgb) * weight[k];
+                sumBlue  += qBlue(rgb)  * weight[k];
+                sumAlpha += qAlpha(rgb) * weight[k];
+            }
+            dst[x - left] = (divideSums(sumRed, sumGreen, sumBlue, sumAlpha, divisor) & mask) |
+                            (src[x] & ~mask);
+        }
+    }
+
+    QVarLengthArray<const QRgb *, 32> lines(taps);
+    for (int y = top; y < bottom; y++) {
+        for (int k = 0; k < taps; k++) {
+            lines[k] = (const QRgb *)scratch.constScanLine(rows.at(y + k));
+        }
+        QRgb *dst = (QRgb *)img.scanLine(y) + left;
+        for (int x = 0; x < span; x++) {
+            int sumRed = 0, sumGreen = 0, sumBlue = 0, sumAlpha = 0;
+            for (int k = 0; k < taps; k++) {
+                QRgb rgb = lines[k][x];
+                sumRed   += qRed(rgb)   * weight[k];
+                sumGreen += qGreen(rgb) * weight[k];
+                sumBlue  += qBlue(rgb)  * weight[k];
+                sumAlpha += qAlpha(rgb) * weight[k];
+            }
+            dst[x] = (divideSums(sumRed, sumGreen, sumBlue, sumAlpha, divisor) & mask) |
+                     (dst[x] & ~mask);
+        }
+    }
+
+    if (img.format() != fmt) {
+        img = img.convertToFormat(fmt);
+    }
+    return true;
+}
+
+// Box blurs size pixels of src into dst with a sliding sum. index is the
+// borderIndex() of the line for this radius.
+static void boxLine(const QRgb *src, QRgb *dst, int size, const int *index, int radius)
+{
+    int count = 2 * radius + 1;
+    int sumRed = 0, sumGreen = 0, sumBlue = 0, sumAlpha = 0;
+    for (int k = 0; k < count; k++) {
+        QRgb rgb = src[index[k]];
+        sumRed += qRed(rgb);
+        sumGreen += qGreen(rgb);
+        sumBlue += qBlue(rgb);
+        sumAlpha += qAlpha(rgb);
+    }
+    for (int x = 0; x < size; x++) {
+        dst[x] = qRgba((sumRed + radius) / count, (sumGreen + radius) / count,
+                       (sumBlue + radius) / count, (sumAlpha + radius) / count);
+        if (x + 1 < size) {
+            QRgb in = src[index[x + count]];
+            QRgb out = src[index[x]];
+            sumRed += qRed(in) - qRed(out);
+            sumGreen += qGreen(in) - qGreen(out);
+            sumBlue += qBlue(in) - qBlue(out);
+            sumAlpha += qAlpha(in) - qAlpha(out);
+        }
+    }
+}
+
+// Finds the span of positions that a box of count pixels reads to produce
+// positions from to to - 1, through the borderIndex() of its line.
+static void boxSpan(const QVector<int> &index, int count, int from, int to, int *first, int *last)
+{
+    int low = index.at(from);
+    int high = low;
+    for (int j = from; j < to - 1 + count; j++) {
+        low = qMin(low, index.at(j));
+        high = qMax(high, index.at(j));
+    }
+    *first = low;
+    *last = high + 1;
+}
+
+/*!
+    \internal
+
+    Blurs the \a clipRect part of \a img with a box blur of each of
+    \a radii in turn, along the rows and then along the columns. Every box
+    is a sliding sum, so the cost per pixel does not depend on the radii.
+    Three boxes of suitable radii are a close approximation of a Gaussian.
+
+    Every box reads the result of the one before around it, so only the
+    span of rows and columns that the clip rect reads through all of the
+    boxes is blurred, pixels outside the clip rect included.
+*/
+bool ConvolutionFilter::boxBlur(QImage &img, const QRect &clipRect, const QVector<int> &radii) const
+{
+    int top = 0;
+    int bottom = img.height();
+    int left = 0;
+    int right = img.width();
+
+    if (!clipRect.isNull()) {
+        // If we have a cliprect, set our coordinates to our cliprect
+        // and make sure it is within the boundaries of the image
+        top = qMax(top, clipRect.top());
+        bottom = qMin(bottom, clipRect.bottom() + 1);
+        left = qMax(left, clipRect.left());
+        right = qMin(right, clipRect.right() + 1);
+    }
+
+    QImage::Format fmt = img.format();
+    if (fmt != QImage::Format_ARGB32 &&
+        (fmt != QImage::Format_RGB32 || (m_channels & ConvolutionFilter::Alpha))) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    }
+    if (img.isNull() || left >= right || top >= bottom || radii.isEmpty()) {
+        return !img.isNull();
+    }
+
+    int width = img.width();
+    int height = img.height();
+    int passes = radii.size();
+    QRgb mask = channelMask();
+    QVector<QVector<int> > columns;
+    QVector<QVector<int> > rows;
+    for (int i = 0; i < passes; i++) {
+        columns.append(borderIndex(width, radii.at(i)));
+        rows.append(borderIndex(height, radii.at(i)));
+    }
+
+    // The span each box has to produce: the clip for the last one, and for
+    // the others the pixels the box after them reads
+    QVector<int> columnFrom(passes + 1), columnTo(passes + 1);
+    QVector<int> rowFrom(passes + 1), rowTo(passes + 1);
+    columnFrom[passes] = left;
+    columnTo[passes] = right;
+    rowFrom[passes] = top;
+    rowTo[passes] = bottom;
+    for (int i = passes - 1; i >= 0; i--) {
+        int count = 2 * radii.at(i) + 1;
+        boxSpan(columns.at(i), count, columnFrom[i + 1], columnTo[i + 1], &columnFrom[i], &columnTo[i]);
+        boxSpan(rows.at(i), count, rowFrom[i + 1], rowTo[i + 1], &rowFrom[i], &rowTo[i]);
+    }
+
+    QImage scratch(width, height, QImage::Format_ARGB32);
+    QImage other(width, height, QImage::Format_ARGB32);
+    if (scratch.isNull() || other.isNull()) {
+        return false;
+    }
+
+    // Along the rows, one row at a time. The column boxes read rows
+    // rowFrom[0] to rowTo[0], and only across the clip
+    QVector<QRgb> line(width);
+    QVector<QRgb> boxed(width);
+    for (int y = rowFrom[0]; y < rowTo[0]; y++) {
+        memcpy(line.data(), img.constScanLine(y), width * sizeof(QRgb));
+        for (int i = 0; i < passes; i++) {
+            int from = columnFrom[i + 1];
+            boxLine(line.constData(), boxed.data() + from, columnTo[i + 1] - from,
+                    columns.at(i).constData() + from, radii.at(i));
+            qSwap(line, boxed);
+        }
+        memcpy((QRgb *)scratch.scanLine(y) + left, line.constData() + left, (right - left) * sizeof(QRgb));
+    }
+
+    // Along the columns, keeping a sliding sum for every column so that the
+    // rows are read in order
+    QImage *from = &scratch;
+    QImage *to = &other;
+    QVector<int> sums(width * 4);
+    for (int i = 0; i < passes; i++) {
+        int radius = radii.at(i);
+        int count = 2 * radius + 1;
+        const int *index = rows.at(i).constData();
+        int first = rowFrom[i + 1];
+        int last = rowTo[i + 1];
+
+        sums.fill(0);
+        int *sum = sums.data();
+        for (int k = 0; k < count; k++) {
+            const QRgb *src = (const QRgb *)from->constScanLine(index[first + k]);
+            for (int x = left; x < right; x++) {
+                sum[x * 4]     += qRed(src[x]);
+                sum[x * 4 + 1] += qGreen(src[x]);
+                sum[x * 4 + 2] += qBlue(src[x]);
+                sum[x * 4 + 3] += qAlpha(src[x]);
+            }
+        }
+        for (int y = first; y < last; y++) {
+            QRgb *dst = (QRgb *)to->scanLine(y);
+            for (int x = left; x < right; x++) {
+                dst[x] = qRgba((sum[x * 4] + radius) / count, (sum[x * 4 + 1] + radius) / count,
+                               (sum[x * 4 + 2] + radius) / count, (sum[x * 4 + 3] + radius) / count);
+            }
+            if (y + 1 < last) {
+                const QRgb *in = (const QRgb *)from->constScanLine(index[y + count]);
+                const QRgb *out = (const QRgb *)from->constScanLine(index[y]);
+                for (int x = left; x < right; x++) {
+                    sum[x * 4]     += qRed(in[x])   - qRed(out[x]);
+                    sum[x * 4 + 1] += qGreen(in[x]) - qGreen(out[x]);
+                    sum[x * 4 + 2] += qBlue(in[x])  - qBlue(out[x]);
+                    sum[x * 4 + 3] += qAlpha(in[x]) - qAlpha(out[x]);
+                }
+            }
+        }
+        qSwap(from, to);
+    }
+
+    // Detach now, so scanLine() below writes to the pixels we read
+    img.bits();
+    for (int y = top; y < bottom; y++) {
+        const QRgb *src = (const QRgb *)from->constScanLine(y);
+        QRgb *dst = (QRgb *)img.scanLine(y);
+        for (int x = left; x < right; x++) {
+            dst[x] = (src[x] & mask) | (dst[x] & ~mask);
+        }
+    }
+
+    if (img.format() != fmt) {
+        img = img.convertToFormat(fmt);
+    }
+    return true;
+}
+
+template <int Channels, bool Border>
+inline QRgb ConvolutionFilter::convolvePixelRGBA(const QRgb * const *rows, const QRgb *centre, int width, int x,
+                                                const int *kernelMatrix, int kernelRows, int kernelColumns,
                                                 int divisor, int bias) const
 {
     int i;
     int j;
-    int rows = kernelRows;
+    int krows = kernelRows;
     int cols = kernelColumns;
 
     int c_offset = x - kernelColumns / 2;
-    int r_offset = y - kernelRows / 2;
 
     int sumRed   = 0;
     int sumGreen = 0;
     int sumBlue  = 0;
     int sumAlpha = 0;
 
-    if (!(m_channels & ConvolutionFilter::Red)  ) sumRed   = qRed (  img.pixel(x, y));
-    if (!(m_channels & ConvolutionFilter::Green)) sumGreen = qGreen( img.pixel(x, y));
-    if (!(m_channels & ConvolutionFilter::Blue )) sumBlue  = qBlue ( img.pixel(x, y));
-    if (!(m_channels & ConvolutionFilter::Alpha)) sumAlpha = qAlpha( img.pixel(x, y));
+    if (!(Channels & ConvolutionFilter::Red)  ) sumRed   = qRed (  centre[x]);
+    if (!(Channels & ConvolutionFilter::Green)) sumGreen = qGreen( centre[x]);
+    if (!(Channels & ConvolutionFilter::Blue )) sumBlue  = qBlue ( centre[x]);
+    if (!(Channels & ConvolutionFilter::Alpha)) sumAlpha = qAlpha( centre[x]);
 
 
+    // rows[i] is source row i of the kernel, with the border policy applied
     for (i = 0; i < cols; i++) {
-        for (j = 0; j < rows; j++) {
+        const QRgb *row = rows[i];
+        for (j = 0; j < krows; j++) {
             int srcpix_x = c_offset + j;
-            int srcpix_y = r_offset + i;
-
-            if (srcpix_x < 0) {
-                switch (m_borderPolicy) {
-                    case ConvolutionFilter::Extend:
-                    srcpix_x = 0;
-                    break;
-                    case ConvolutionFilter::Mirror:
-                    srcpix_x = -srcpix_x;
-                    srcpix_x %= img.width();
-                    break;
-                    case ConvolutionFilter::Wrap:
-                    // In case of a large kernel and a small image, make sure we are in the bounds of the image coords
-                    while (srcpix_x < 0) {
-                        srcpix_x += img.width();
-                    }
-                    break;
-                }
-            }else if (srcpix_x >= img.width()) {
-                switch (m_borderPolicy) {
-                    case ConvolutionFilter::Extend:
-                    srcpix_x = img.width() - 1;
-                    break;
-                    case ConvolutionFilter::Mirror:
-                    srcpix_x %= img.width();
-                    srcpix_x = img.width() - 1 - srcpix_x;
-                    break;
-                    case ConvolutionFilter::Wrap:
-                    srcpix_x %= img.width();
-                    break;
-                }
-            }
-
-            if (srcpix_y < 0) {
-                switch (m_borderPolicy) {
-                    case ConvolutionFilter::Extend:
-                    srcpix_y = 0;
-                    break;
-                    case ConvolutionFilter::Mirror:
-                    srcpix_y = -srcpix_y;
-                    srcpix_y %= img.height();
-                    break;
-                    case ConvolutionFilter::Wrap:
-                    // In case of a large kernel and a small image, make sure we are in the bounds of the image coords
-                    while (srcpix_y < 0) {
-                        srcpix_y += img.height();
-                    }
-                    break;
-                }
-            }else if (srcpix_y >= img.height()) {
-                switch (m_borderPolicy) {
-                    case ConvolutionFilter::Extend:
-                    srcpix_y = img.height() - 1;
-                    break;
-                    case ConvolutionFilter::Mirror:
-                    srcpix_y %= img.height();
-                    srcpix_y = img.height() - 1 - srcpix_y;
-                    break;
-                    case ConvolutionFilter::Wrap:
-                    srcpix_y %= img.height();
-                    break;
-                }
+            if (Border && (srcpix_x < 0 || srcpix_x >= width)) {
+                srcpix_x = borderPixel(srcpix_x, width);
             }
 
-            QRgb rgb = img.pixel(srcpix_x, srcpix_y);
-            int weight = kernelMatrix[i * rows + j];
-            if (m_channels & ConvolutionFilter::Red)    sumRed   += qRed(rgb)   * weight;
-            if (m_channels & ConvolutionFilter::Green)  sumGreen += qGreen(rgb) * weight;
-            if (m_channels & ConvolutionFilter::Blue)   sumBlue  += qBlue(rgb)  * weight;
-            if (m_channels & ConvolutionFilter::Alpha)  sumAlpha += qAlpha(rgb) * weight;
+            QRgb rgb = row[srcpix_x];
+            int weight = kernelMatrix[i * krows + j];
+            if (Channels & ConvolutionFilter::Red)    sumRed   += qRed(rgb)   * weight;
+            if (Channels & ConvolutionFilter::Green)  sumGreen += qGreen(rgb) * weight;
+            if (Channels & ConvolutionFilter::Blue)   sumBlue  += qBlue(rgb)  * weight;
+            if (Channels & ConvolutionFilter::Alpha)  sumAlpha += qAlpha(rgb) * weight;
         }
     }
 
-    if (m_channels & ConvolutionFilter::Red)
+    if (Channels & ConvolutionFilter::Red)
     {
         if (divisor) sumRed/=divisor;
         sumRed = qBound(0, sumRed + bias, 255);
     }
 
-    if (m_channels & ConvolutionFilter::Green)
+    if (Channels & ConvolutionFilter::Green)
     {
         if (divisor) sumGreen/=divisor;
         sumGreen = qBound(0, sumGreen + bias, 255);
     }
 
-    if (m_channels & ConvolutionFilter::Blue)
+    if (Channels & ConvolutionFilter::Blue)
     {
         if (divisor) sumBlue/=divisor;
         sumBlue = qBound(0, sumBlue + bias, 255);
     }
 
-    if (m_channels & ConvolutionFilter::Alpha)
+    if (Channels & ConvolutionFilter::Alpha)
     {
         if (divisor) sumAlpha/=divisor;
         sumAlpha = qBound(0, sumAlpha + bias, 255);
@@ -427,3 +835,53 @@ QRgb ConvolutionFilter::convolvePixelRGBA(const QImage &img, int x, int y, const
 
     return qRgba(sumRed, sumGreen, sumBlue, sumAlpha);
 }
+
+// Convolves pixels [left, right) of one row into out. Only the pixels whose
+// kernel reaches past either end of the row apply the border policy; the
+// ones in between read the row directly.
+template <int Channels>
+void ConvolutionFilter::convolveRowRGBA(const QRgb * const *rows, const QRgb *centre, int width,
+                                        int left, int right,
+                                        const int *kernelMatrix, int kernelRows, int kernelColumns,
+                                        int divisor, int bias, QRgb *out) const
+{
+    int innerLeft = qBound(left, kernelColumns / 2, right);
+    int innerRight = qBound(innerLeft, width - kernelRows + kernelColumns / 2 + 1, right);
+    int x;
+
+    for (x = left; x < innerLeft; x++) {
+        *out++ = convolvePixelRGBA<Channels, true>(rows, centre, width, x, kernelMatrix,
+                                                   kernelRows, kernelColumns, divisor, bias);
+    }
+    for (; x < innerRight; x++) {
+        *out++ = convolvePixelRGBA<Channels, false>(rows, centre, width, x, kernelMatrix,
+                                                    kernelRows, kernelColumns, divisor, bias);
+    }
+    for (; x < right; x++) {
+        *out++ = convolvePixelRGBA<Channels, true>(rows, centre, width, x, kernelMatrix,
+                                                   kernelRows, kernelColumns, divisor, bias);
+    }
+}
+
+// Picks the row convolution specialised for the channels being filtered.
+ConvolutionFilter::RowFunction ConvolutionFilter::rowFunction() const
+{
+    switch (int(m_channels) & RGBA) {
+        case 0x0: return &ConvolutionFilter::convolveRowRGBA<0x0>;
+        case 0x1: return &ConvolutionFilter::convolveRowRGBA<0x1>;
+        case 0x2: return &ConvolutionFilter::convolveRowRGBA<0x2>;
+        case 0x3: return &ConvolutionFilter::convolveRowRGBA<0x3>;
+        case 0x4: return &ConvolutionFilter::convolveRowRGBA<0x4>;
+        case 0x5: return &ConvolutionFilter::convolveRowRGBA<0x5>;
+        case 0x6: return &ConvolutionFilter::convolveRowRGBA<0x6>;
+        case 0x7: return &ConvolutionFilter::convolveRowRGBA<0x7>;
+        case 0x8: return &ConvolutionFilter::convolveRowRGBA<0x8>;
+        case 0x9: return &ConvolutionFilter::convolveRowRGBA<0x9>;
+        case 0xa: return &ConvolutionFilter::convolveRowRGBA<0xa>;
+        case 0xb: return &ConvolutionFilter::convolveRowRGBA<0xb>;
+        case 0xc: return &ConvolutionFilter::convolveRowRGBA<0xc>;
+        case 0xd: return &ConvolutionFilter::convolveRowRGBA<0xd>;
+        case 0xe: return &ConvolutionFilter::convolveRowRGBA<0xe>;
+        default:  return &ConvolutionFilter::convolveRowRGBA<0xf>;
+    }
+}
@@ -93,6 +93,10 @@ public:
     bool setOption(int option, const QVariant &value);
     bool supportsOption(int option) const;
     QImage apply(const QImage &image, const QRect& clipRect = QRect() ) const;
+    bool applyInPlace(QImage &image, const QRect& clipRect = QRect() ) const;
+    int contextRows() const;
+    bool applyToRows(const QtScanlineWindow &input, int top, int bottom, int left, int right,
+                     uchar *output, int bytesPerLine, const QtImageFilterRowState *state) const;
     QString name() const { return m_name; }
     QString description() const { return m_description; }
     ~ConvolutionFilter();
@@ -108,6 +112,10 @@ public:
     }
 
 protected:
+    bool convolveSeparable(QImage &image, const QRect &clipRect,
+                           const QVector<int> &weights, int divisor) const;
+    bool boxBlur(QImage &image, const QRect &clipRect, const QVector<int> &radii) const;
+
     FilterChannels m_channels;
     FilterBorderPolicy m_borderPolicy;
     QVector<KernelMatrixData> m_kernels;
@@ -119,9 +127,23 @@ private:
     bool setBorderPolicy(const QString &borderPolicy);
     QString getBorderPolicy() const;
 
-    QImage convolve(const QImage &img, const QRect& clipRect) const;
-    QRgb convolvePixelRGBA(   const QImage &img, int x, int y, const int *kernelMatrix, int kernelRows, int kernelColumns, 
+    int borderPixel(int i, int size) const;
+    QVector<int> borderIndex(int size, int reach) const;
+    QRgb channelMask() const;
+    template <int Channels, bool Border>
+    QRgb convolvePixelRGBA(   const QRgb * const *rows, const QRgb *centre, int width, int x,
+                                    const int *kernelMatrix, int kernelRows, int kernelColumns,
                                     int divisor, int bias) const;
+    template <int Channels>
+    void convolveRowRGBA(   const QRgb * const *rows, const QRgb *centre, int width,
+                                    int left, int right,
+                                    const int *kernelMatrix, int kernelRows, int kernelColumns,
+                                    int divisor, int bias, QRgb *out) const;
+
+    typedef void (ConvolutionFilter::*RowFunction)(const QRgb * const *, const QRgb *, int,
+                                                   int, int, const int *, int, int,
+                                                   int, int, QRgb *) const;
+    RowFunction rowFunction() const;
 
 private:
     QString  m_name;
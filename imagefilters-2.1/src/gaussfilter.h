@@ -54,12 +54,16 @@
 #define M_PI 3.1415926535897932384626433832795
 #endif
 
+// Radii above this are blurred with three box blurs, whose cost does not
+// depend on the radius, instead of with the Gaussian kernel itself
+#define GAUSSBLUR_MAX_KERNEL_RADIUS 4
+
 class GaussBlurFilter : public ConvolutionFilter
 {
     public:
         GaussBlurFilter() : ConvolutionFilter()
         {
-            m_radius = 4.0;
+            setRadius(4.0);
         }
 
         ////
@@ -74,7 +78,7 @@ class GaussBlurFilter : public ConvolutionFilter
                 case QtImageFilter::Radius:
                 {
                     double radius = value.toDouble(&ok);
-                    if (ok) m_radius = radius;
+                    if (ok) setRadius(radius);
                 }
                 break;
 
@@ -91,13 +95,28 @@ class GaussBlurFilter : public ConvolutionFilter
             return ConvolutionFilter::supportsOption(option);
         }
 
-	QImage apply(const QImage &image, const QRect& clipRect ) const;
+	bool applyInPlace(QImage &image, const QRect& clipRect = QRect() ) const;
+
+        // The separable and box blurs run over whole columns, so only
+        // kernels set as options can be applied a range of rows at a time
+        int contextRows() const
+        {
+            if (!m_boxRadii.isEmpty() || !m_weights.isEmpty()) return -1;
+            return ConvolutionFilter::contextRows();
+        }
         
 	QString name() const { return QLatin1String("GaussBlur"); }
         QString description() const { return QObject::tr("A gaussian blur filter", "GaussBlurFilter"); }
 
     private:
+        void setRadius(qreal radius);
+
         qreal m_radius;
+        // The kernel for m_radius, applied along the rows and then the columns
+        QVector<int> m_weights;
+        int m_divisor;
+        // Radii of the box blurs that approximate the kernel, if it is large
+        QVector<int> m_boxRadii;
 };
 
 
@@ -121,32 +140,57 @@ QVariant GaussBlurFilter::option(int option) const
     return ConvolutionFilter::option(option);
 }
 
-QImage GaussBlurFilter::apply(const QImage &image, const QRect& clipRect ) const
+void GaussBlurFilter::setRadius(qreal radius)
 {
-    bool ok = true;
-    if (m_radius > 0.0) {
-        int uRadius = (int)ceil(m_radius);
-
-        double deviance = sqrt(-m_radius*m_radius/(2*log(1/255.0)));
-        QtMatrix<double> matLeft(2 * uRadius + 1, 1);
+    m_radius = radius;
+    m_weights.clear();
+    m_divisor = 0;
+    m_boxRadii.clear();
+    if (m_radius <= 0.0) {
+        return;
+    }
 
-        for (int x = -uRadius; x <=uRadius; x++) {
-            matLeft.setData(uRadius + x, 0, Gauss2DFunction(x, 0, deviance));
+    int uRadius = (int)ceil(m_radius);
+    double deviance = sqrt(-m_radius*m_radius/(2*log(1/255.0)));
+    if (uRadius <= GAUSSBLUR_MAX_KERNEL_RADIUS) {
+        // Weights scaled so the centre one is 255
+        double scalar = Gauss2DFunction(0, 0, deviance);
+        for (int x = -uRadius; x <= uRadius; x++) {
+            int weight = qRound(Gauss2DFunction(x, 0, deviance) * 255.0 / scalar);
+            m_weights.append(weight);
+            m_divisor += weight;
         }
-        double scalar = matLeft.at(uRadius, 0);
-        matLeft*=(255.0/scalar);
-        QtMatrix<double> matRight = matLeft.transposed();
-        
-        QtConvolutionKernelMatrix integerMatrixLeft = convertMatrixBasetype<int,double>(matLeft);
-        QtConvolutionKernelMatrix integerMatrixRight = convertMatrixBasetype<int,double>(matRight);
-        
-        GaussBlurFilter *localThis = const_cast<GaussBlurFilter*>(this);
-        localThis->addKernel(integerMatrixLeft, m_channels, m_borderPolicy);
-        localThis->addKernel(integerMatrixRight, m_channels, m_borderPolicy);
     } else {
-        ok = false;
+        // Three boxes of odd widths whose variances add up to the
+        // Gaussian's, the narrower ones first
+        const int boxes = 3;
+        double variance = deviance * deviance;
+        int lower = (int)floor(sqrt(12.0 * variance / boxes + 1.0));
+        if (lower % 2 == 0) {
+            lower--;
+        }
+        int upper = lower + 2;
+        int lowerCount = qRound((12.0 * variance - boxes * lower * lower - 4 * boxes * lower - 3 * boxes)
+                                / (-4.0 * lower - 4.0));
+        for (int i = 0; i < boxes; i++) {
+            m_boxRadii.append(((i < lowerCount) ? lower : upper) / 2);
+        }
+    }
+}
+
+bool GaussBlurFilter::applyInPlace(QImage &image, const QRect& clipRect ) const
+{
+    // Kernels added with the ConvolutionKernelMatrix option come first
+    if (!m_kernels.isEmpty() && !ConvolutionFilter::applyInPlace(image, clipRect)) {
+        return false;
+    }
+    if (!m_boxRadii.isEmpty()) {
+        return boxBlur(image, clipRect, m_boxRadii);
+    }
+    if (!m_weights.isEmpty()) {
+        return convolveSeparable(image, clipRect, m_weights, m_divisor);
     }
-    return ConvolutionFilter::apply(image, clipRect);
+    return m_kernels.isEmpty() ? ConvolutionFilter::applyInPlace(image, clipRect) : true;
 }
 
 #endif //GAUSSBLURFILTER_H
@@ -111,52 +111,27 @@ static QRgb weighpixel(QRgb rgb, int percentage)
 }
 
 /*
- * Gets a pixel at a floating-point coordinate, thus causing it to take into accountance
- * neighbour pixels if one of the coordinates have a fractional part.
- * This should be used if you need to fetch pixels from fractional positions and want to
- * minimize the rounding errors and aliasing effects that gives.
+ * Gets a pixel at a fractional position, as mapped by a PunchSample, thus causing it to
+ * take into accountance neighbour pixels if one of the coordinates have a fractional part.
  *
- * The function will calculate the pixel value by calculating all areas the pixel
- * occupies in each neighbouring pixel. The function also assumes that the pixel to get
- * have the same dimensions as a regular pixel. (Thus, a "subpixel" can cover at most 4 pixels)
+ * The pixel value is calculated from all areas the pixel occupies in each neighbouring
+ * pixel. The function also assumes that the pixel to get have the same dimensions as a
+ * regular pixel. (Thus, a "subpixel" can cover at most 4 pixels)
  */
-
-static QRgb getSubpixel(const QImage &img, double x, double y)
+static inline QRgb getSubpixel(const QRgb *bits, int offset, int right, int below, int fx, int fy)
 {
-    int fx = fixedfraction(x);
-    int fy = fixedfraction(y);
-
-    int px = (int)x;
-    int py = (int)y;
-
-    QRgb p1;
-    QRgb p2;
-    QRgb p3;
-    QRgb p4;
-
-    int right = 1;
-    int below = 1;
-    if (py >= img.height() - 1 ) {
-        // We are partially outside the image, do our best here.
-        below = 0;
-    }
-    if (px >= img.width() - 1) {
-        // We are partially outside the image, do our best here.
-        right = 0;
-    }
+    const QRgb *p = bits + offset;
+    QRgb p1 = weighpixel(p[0],              (FIXEDPOINT_MULTIPLIER-fx)*(FIXEDPOINT_MULTIPLIER-fy));
+    QRgb p2 = weighpixel(p[right],          fx*(FIXEDPOINT_MULTIPLIER-fy));
+    QRgb p3 = weighpixel(p[below],          (FIXEDPOINT_MULTIPLIER-fx)*fy);
+    QRgb p4 = weighpixel(p[right + below],  fx*fy);
 
-    p1 = weighpixel(img.pixel(px,       py),            (FIXEDPOINT_MULTIPLIER-fx)*(FIXEDPOINT_MULTIPLIER-fy));
-    p2 = weighpixel(img.pixel(px+right, py),            fx*(FIXEDPOINT_MULTIPLIER-fy));
-    p3 = weighpixel(img.pixel(px,       py+below),      (FIXEDPOINT_MULTIPLIER-fx)*fy);
-    p4 = weighpixel(img.pixel(px+right, py+below),      fx*fy);
-    
     return qRgb((qRed(p1) + qRed(p2) + qRed(p3) + qRed(p4)),
                 (qGreen(p1) + qGreen(p2) + qGreen(p3) + qGreen(p4)),
                 (qBlue(p1) + qBlue(p2) + qBlue(p3) + qBlue(p4)));
-
 }
 
-PunchFilter::PunchFilter() : m_Radius(10.0), m_Center(0.0,0.0), m_Force(0.5)
+PunchFilter::PunchFilter() : m_Radius(10.0), m_Center(0.0,0.0), m_Force(0.5), m_MapStride(0)
 {
 }
 
@@ -204,6 +179,11 @@ bool PunchFilter::setOption(int option, const QVariant &value)
             bOK = false;
         break;
     }
+    if (bOK) {
+        QMutexLocker locker(&m_MapLock);
+        m_Map.clear();
+        m_MapSize = QSize();
+    }
     return bOK;
 }
 
@@ -234,51 +214,41 @@ bool PunchFilter::supportsOption(int option) const
         || option == QtImageFilter::Force);
 }
 
-bool PunchFilter::Punch(const QImage &img, QImage *outputImage, const QRect &clipRect /*= QRect()*/ ) const
+/*
+ * Works out where each pixel of \a bounds in an image of \a size, with \a stride
+ * pixels from one scanline to the next, is sampled from. The map only depends on the
+ * options and the image layout, so it is reused for as long as they stay the same,
+ * and a new image is just sampled through it.
+ */
+QVector<PunchFilter::PunchSample> PunchFilter::displacementMap(const QSize &size, int stride, const QRect &bounds) const
 {
-    *outputImage = img;
-    int top = 0;
-    int bottom = img.height();
-    int left = 0;
-    int right = img.width();
-
-    if (!clipRect.isNull()) {
-        // If we have a cliprect, set our coordinates to our cliprect
-        // and make sure it is within the boundaries of the image
-        // After that, an optimization where we adjust the cliprect to only be the bounding 
-        // rect of the circle we are manipulating, (so that we don't have to run the filter on 
-        // the whole image if the default cliprect was given).
-        top = qMax(top, clipRect.top());
-        top = qMax(top, (int)(ceil(m_Center.y() - 1) - m_Radius));
-        bottom = qMin(bottom, clipRect.bottom());
-        bottom = qMin(bottom, (int)(floor(m_Center.y() + 1) + m_Radius));
-        left = qMax(left, clipRect.left());
-        left = qMax(left, (int)(ceil(m_Center.x() - 1) - m_Radius));
-        right = qMin(right, clipRect.right());
-        right = qMin(right, (int)(floor(m_Center.x() + 1) + m_Radius));
+    QMutexLocker locker(&m_MapLock);
+    if (m_MapSize == size && m_MapStride == stride && m_MapBounds == bounds) {
+        return m_Map;
     }
 
+    int width = size.width();
+    int height = size.height();
     qreal centerx = m_Center.x();
     qreal centery = m_Center.y();
-
-    int x;
-    int y;
     double amplitude = m_Force/3.2; // scale down
     //amplitude = qBound(-0.3125, amplitude, 0.3125);
 
-    for (y = top; y < bottom; y++) {
-        for (x = left; x < right; x++) {
+    QVector<PunchSample> map(bounds.width() * bounds.height());
+    PunchSample *sample = map.data();
+    for (int y = bounds.top(); y <= bounds.bottom(); y++) {
+        for (int x = bounds.left(); x <= bounds.right(); x++, sample++) {
             qreal dx = x - centerx;
             qreal dy = y - centery;
             double distance = sqrt(dx * dx + dy * dy);
-            QRgb rgb;
+            sample->offset = -1;
             if (distance <= m_Radius + M_SQRT2) {   // M_SQRT2 is the maximum "width" of a pixel. (If measured diagonally)
                                                     // we must evaluate this area "outside" the radius also to reduce aliasing effects.
                 double distort = distance / m_Radius;
                 if (distort > 0.0 && distort < 1.0) {
                     distort = punch_xform(distort, amplitude);
                 }
-                
+
                 // Normalize the distance vector and find the length after distortion
                 if (dx != 0 || dy != 0) {
                     double mag = m_Radius/sqrt(dx * dx + dy * dy);
@@ -290,11 +260,80 @@ bool PunchFilter::Punch(const QImage &img, QImage *outputImage, const QRect &cli
                 double tx = centerx + dx;
                 double ty = centery + dy;
                 // Crop off any overflows. This happens since we are adding M_SQRT2 to the radius to evaluate a small area outside the radius circle.
-                if (tx > img.width()  || tx < 0) tx = x;
-                if (ty > img.height() || ty < 0) ty = y;
-                
-                rgb = getSubpixel(img, tx, ty);
-                outputImage->setPixel(x, y, rgb);
+                if (tx > width  || tx < 0) tx = x;
+                if (ty > height || ty < 0) ty = y;
+
+                // A position on the far edge is sampled from the last pixel
+                int px = qMin((int)tx, width - 1);
+                int py = qMin((int)ty, height - 1);
+                sample->offset = py * stride + px;
+                // We are partially outside the image, do our best here.
+                sample->right = (px >= width - 1) ? 0 : 1;
+                sample->below = (py >= height - 1) ? 0 : stride;
+                sample->fx = fixedfraction(tx);
+                sample->fy = fixedfraction(ty);
+            }
+        }
+    }
+
+    m_Map = map;
+    m_MapSize = size;
+    m_MapStride = stride;
+    m_MapBounds = bounds;
+    return map;
+}
+
+bool PunchFilter::Punch(const QImage &img, QImage *outputImage, const QRect &clipRect /*= QRect()*/ ) const
+{
+    // The samples read the pixels directly as 32 bits
+    QImage source = img;
+    if (source.format() != QImage::Format_RGB32 && source.format() != QImage::Format_ARGB32) {
+        source = source.convertToFormat(QImage::Format_ARGB32);
+    }
+    *outputImage = source;
+    int top = 0;
+    int bottom = source.height();
+    int left = 0;
+    int right = source.width();
+
+    // Only pixels within M_SQRT2 of the circle are sampled, the rest are left as
+    // they are, so the map never needs to cover more than the circle's bounding box
+    top = qMax(top, (int)floor(m_Center.y() - m_Radius - M_SQRT2));
+    bottom = qMin(bottom, (int)ceil(m_Center.y() + m_Radius + M_SQRT2) + 1);
+    left = qMax(left, (int)floor(m_Center.x() - m_Radius - M_SQRT2));
+    right = qMin(right, (int)ceil(m_Center.x() + m_Radius + M_SQRT2) + 1);
+
+    if (!clipRect.isNull()) {
+        // If we have a cliprect, set our coordinates to our cliprect
+        // and make sure it is within the boundaries of the image
+        // After that, an optimization where we adjust the cliprect to only be the bounding 
+        // rect of the circle we are manipulating, (so that we don't have to run the filter on 
+        // the whole image if the default cliprect was given).
+        top = qMax(top, clipRect.top());
+        top = qMax(top, (int)(ceil(m_Center.y() - 1) - m_Radius));
+        bottom = qMin(bottom, clipRect.bottom() + 1);
+        bottom = qMin(bottom, (int)(floor(m_Center.y() + 1) + m_Radius));
+        left = qMax(left, clipRect.left());
+        left = qMax(left, (int)(ceil(m_Center.x() - 1) - m_Radius));
+        right = qMin(right, clipRect.right() + 1);
+        right = qMin(right, (int)(floor(m_Center.x() + 1) + m_Radius));
+    }
+    if (source.isNull() || left >= right || top >= bottom) {
+        return !source.isNull();
+    }
+
+    // The offsets step through whole scanlines, padding included
+    int stride = source.bytesPerLine() / sizeof(QRgb);
+    QVector<PunchSample> map = displacementMap(source.size(), stride, QRect(left, top, right - left, bottom - top));
+    const PunchSample *sample = map.constData();
+    const QRgb *bits = (const QRgb *)source.constScanLine(0);
+
+    for (int y = top; y < bottom; y++) {
+        QRgb *out = (QRgb *)outputImage->scanLine(y);
+        for (int x = left; x < right; x++, sample++) {
+            if (sample->offset >= 0) {
+                out[x] = getSubpixel(bits, sample->offset, sample->right, sample->below,
+                                     sample->fx, sample->fy);
             }
         }
     }
@@ -48,6 +48,8 @@
 #define PUNCHFILTER_H
 
 #include "qtimagefilter.h"
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
 
 class PunchFilter : public QtImageFilter {
 public:
@@ -63,11 +65,30 @@ public:
     QString description() const { return QObject::tr("A parametrized circular pinch/punch filter", "PunchFilter"); }
 
 private:
+    // Where an output pixel is sampled from in the source image
+    struct PunchSample {
+        int offset;     // Top left source pixel, or -1 if the pixel is left as it is
+        int right;      // Steps to the pixels to the right and below, 0 at the edges
+        int below;
+        int fx;         // Fractional position in FIXEDPOINT_FRACTIONBITS bits
+        int fy;
+    };
+
     bool Punch(const QImage &img, QImage *outputImage, const QRect &clipRect = QRect() ) const;
+    QVector<PunchSample> displacementMap(const QSize &size, int stride, const QRect &bounds) const;
 
 private:
     double      m_Radius;
     QPointF     m_Center;
     double      m_Force;
+
+    // Displacement map for the options above, images of m_MapSize with
+    // m_MapStride pixels per scanline and the area m_MapBounds. Cleared when
+    // an option changes
+    mutable QMutex                  m_MapLock;
+    mutable QVector<PunchSample>    m_Map;
+    mutable QSize                   m_MapSize;
+    mutable int                     m_MapStride;
+    mutable QRect                   m_MapBounds;
 };
 #endif  /* PUNCHFILTER_H */
@@ -46,6 +46,7 @@
 
 #include "qtimagefilter.h"
 #include <QtCore/QObject>
+#include <string.h>
 /*!
     \class QtImageFilter
 
@@ -102,6 +103,23 @@
     \sa QtImageFilterFactory
 */
 
+/*!
+    \class QtScanlineWindow
+
+    \brief The QtScanlineWindow class is a read only view of the
+    scanlines of a 32-bit image that may only be partly in memory.
+
+    The rows are kept in a buffer of a fixed number of scanlines that
+    is used as a ring, so scanline y is held in row y modulo the buffer
+    height. A buffer as high as the image holds the whole image. A
+    smaller buffer holds a sliding band of it, which is how an image is
+    streamed through filters without ever having all of it in memory.
+    The caller makes sure the rows it asks for are currently in the
+    band.
+
+    \sa QtImageFilter::applyToRows()
+*/
+
 /*!
     \enum QtImageFilter::FilterOption
 
@@ -203,13 +221,196 @@ bool QtImageFilter::supportsOption(int filteroption) const
     This function is used by the QtImageFilters framework to apply the
     filter on the given \a image, returning the resulting filtered
     image. The \a clipRectangle parameter delimits the area that is
-    filtered.
+    filtered, right and bottom edges included. Filters that read the
+    pixels around each one read them from the whole image, outside
+    \a clipRectangle as well, and geometry such as the centre of the
+    effect is that of the whole image, so filtering a part of an image
+    gives the same pixels as filtering all of it.
 
     This is a pure virtual function that must be implemented in
     derived classes. The format of the returned image should be the
     same as the input image format (unless documented otherwise).
 */
 
+/*!
+    Applies the filter on the given \a image, replacing its contents
+    with the filtered image, and returns true if the filtering
+    succeeds. The \a clipRectangle parameter delimits the area that is
+    filtered.
+
+    Filters that do not change the size of the image should
+    reimplement this function to work on the pixels of \a image
+    directly. That saves allocating and copying a whole new image for
+    every filter applied. The default implementation assigns the result
+    of apply() to \a image.
+
+    \sa apply()
+*/
+bool QtImageFilter::applyInPlace(QImage &image, const QRect& clipRectangle) const
+{
+    image = apply(image, clipRectangle);
+    return !image.isNull();
+}
+
+/*!
+    \enum QtImageFilter::FilterKind
+
+    This enum describes which pixels of the input an output pixel of
+    the filter depends on. A filter graph uses it to decide which
+    filters can be merged and run a scanline at a time.
+
+    \value ChannelLookupFilter Each channel of an output pixel depends
+    only on the same channel of the input pixel at the same place. A
+    run of such filters can be collapsed into one lookup table.
+
+    \value PointwiseFilter An output pixel depends only on the input
+    pixel at the same place, and on its position.
+
+    \value NeighbourhoodFilter An output pixel depends on the input
+    pixels around it.
+
+    \value GeometryFilter The filter changes the size of the image or
+    moves its pixels.
+
+    \sa kind()
+*/
+
+/*!
+    Returns the kind of the filter with its current options.
+
+    Filters that return ChannelLookupFilter or PointwiseFilter must
+    reimplement processRow(). The default implementation returns
+    NeighbourhoodFilter, which is always safe as the filter is then
+    only ever applied to the whole image.
+
+    \sa FilterKind, processRow()
+*/
+QtImageFilter::FilterKind QtImageFilter::kind() const
+{
+    return NeighbourhoodFilter;
+}
+
+/*!
+    Returns true if the filter with its current options leaves every
+    image as it is, so that it need not be applied at all. The default
+    implementation returns false.
+*/
+bool QtImageFilter::isIdentity() const
+{
+    return false;
+}
+
+/*!
+    \class QtImageFilterRowState
+
+    \brief The QtImageFilterRowState class is the base of whatever a
+    filter works out once per image for processRow().
+
+    \sa QtImageFilter::prepareRows()
+*/
+
+/*!
+    Works out what processRow() needs for every row of an image of the
+    given \a size, such as tables that only depend on the size and the
+    options, and returns it. The same state is passed to every
+    processRow() call for the image, from any thread.
+
+    The default implementation returns a null pointer.
+
+    \sa processRow()
+*/
+QSharedPointer<const QtImageFilterRowState> QtImageFilter::prepareRows(const QSize &size) const
+{
+    Q_UNUSED(size);
+    return QSharedPointer<const QtImageFilterRowState>();
+}
+
+/*!
+    Filters pixels \a left to \a right, right excluded, of scanline \a y
+    of an image of the given \a size in place. \a row holds the 32-bit
+    pixels of the scanline, each at its column in the image, and
+    \a state is what prepareRows() returned for the image. Only called
+    for filters whose kind() is ChannelLookupFilter or PointwiseFilter.
+    Rows may be processed in any order and from several threads at
+    once.
+
+    A ChannelLookupFilter is also run over a row that holds every
+    channel value once, with a null \a state, to collapse it into a
+    lookup table.
+
+    The default implementation does nothing.
+
+    \sa kind(), prepareRows()
+*/
+void QtImageFilter::processRow(QRgb *row, int y, int left, int right, const QSize &size,
+                               const QtImageFilterRowState *state) const
+{
+    Q_UNUSED(row);
+    Q_UNUSED(y);
+    Q_UNUSED(left);
+    Q_UNUSED(right);
+    Q_UNUSED(size);
+    Q_UNUSED(state);
+}
+
+/*!
+    Returns the number of scanlines above and below a row that
+    applyToRows() reads to filter it, or -1 if the filter cannot be
+    applied a range of rows at a time.
+
+    The default implementation returns 0 for filters whose kind() is
+    ChannelLookupFilter or PointwiseFilter, and -1 for all others.
+
+    \sa applyToRows()
+*/
+int QtImageFilter::contextRows() const
+{
+    FilterKind filterKind = kind();
+    return (filterKind == ChannelLookupFilter || filterKind == PointwiseFilter) ? 0 : -1;
+}
+
+/*!
+    Filters pixels \a left to \a right, right excluded, of scanlines
+    \a top to \a bottom - 1 of an image, reading from the \a input
+    window and writing 32-bit pixels to \a output, whose rows are
+    \a bytesPerLine bytes apart. Row \a top is written to the first
+    row of \a output, and each pixel to its column in the image.
+    \a state is what prepareRows() returned for the image.
+
+    The \a input window must hold the 32-bit pixels of rows top -
+    contextRows() to bottom - 1 + contextRows() that are inside the
+    image. This lets several filters be run one after another over a
+    band of rows small enough to stay in the processor cache, rather
+    than over the whole image at a time. Ranges of rows may be filtered
+    in any order and from several threads at once. \a output must not
+    overlap the rows of \a input, except that for a filter whose
+    contextRows() is 0 it may be the input rows themselves.
+
+    Returns false if the filter cannot be applied a range of rows at a
+    time, in which case contextRows() returns -1. The default
+    implementation copies each row and runs processRow() on it for
+    pointwise filters.
+
+    \sa contextRows(), processRow()
+*/
+bool QtImageFilter::applyToRows(const QtScanlineWindow &input, int top, int bottom, int left, int right,
+                                uchar *output, int bytesPerLine,
+                                const QtImageFilterRowState *state) const
+{
+    if (contextRows() != 0) {
+        return false;
+    }
+    QSize size(input.width(), input.height());
+    for (int y = top; y < bottom; ++y) {
+        QRgb *row = (QRgb *)(output + (y - top) * bytesPerLine);
+        if (row != input.row(y)) {
+            memcpy(row + left, input.row(y) + left, (right - left) * sizeof(QRgb));
+        }
+        processRow(row, y, left, right, size, state);
+    }
+    return true;
+}
+
 /*!
     \fn QString QtImageFilter::name() const
 
@@ -50,6 +50,7 @@
 #include <QtCore/QString>
 #include <QtCore/QVariant>
 #include <QtCore/QStringList>
+#include <QtCore/QSharedPointer>
 #include "qtmatrix.h"
 
 #if defined(Q_WS_WIN)
@@ -69,6 +70,36 @@
 #endif
 
 
+class QtScanlineWindow {
+public:
+    QtScanlineWindow(const QImage &image)
+        : m_bits(image.bits()), m_bytesPerLine(image.bytesPerLine()),
+          m_rows(image.height()), m_width(image.width()), m_height(image.height()) {}
+
+    QtScanlineWindow(const uchar *bits, int bytesPerLine, int rows, int width, int height)
+        : m_bits(bits), m_bytesPerLine(bytesPerLine),
+          m_rows(rows), m_width(width), m_height(height) {}
+
+    const QRgb *row(int y) const
+    { return (const QRgb *)(m_bits + (y % m_rows) * m_bytesPerLine); }
+
+    int width() const { return m_width; }
+
+    int height() const { return m_height; }
+
+private:
+    const uchar *m_bits;
+    int m_bytesPerLine;
+    int m_rows;
+    int m_width;
+    int m_height;
+};
+
+class QT_QTIMAGEFILTERS_EXPORT QtImageFilterRowState {
+public:
+    virtual ~QtImageFilterRowState() {}
+};
+
 class QT_QTIMAGEFILTERS_EXPORT QtImageFilter {
 public:
     enum FilterOption {
@@ -83,6 +114,13 @@ public:
         UserOption = 0x100
     };
 
+    enum FilterKind {
+        ChannelLookupFilter,
+        PointwiseFilter,
+        NeighbourhoodFilter,
+        GeometryFilter
+    };
+
     virtual QVariant option(int filteroption) const;
 
     virtual bool setOption(int filteroption, const QVariant &value);
@@ -91,6 +129,23 @@ public:
 
     virtual QImage apply(const QImage &img, const QRect& clipRect = QRect() ) const = 0;
 
+    virtual bool applyInPlace(QImage &img, const QRect& clipRect = QRect() ) const;
+
+    virtual FilterKind kind() const;
+
+    virtual bool isIdentity() const;
+
+    virtual QSharedPointer<const QtImageFilterRowState> prepareRows(const QSize &size) const;
+
+    virtual void processRow(QRgb *row, int y, int left, int right, const QSize &size,
+                            const QtImageFilterRowState *state) const;
+
+    virtual int contextRows() const;
+
+    virtual bool applyToRows(const QtScanlineWindow &input, int top, int bottom, int left, int right,
+                             uchar *output, int bytesPerLine,
+                             const QtImageFilterRowState *state) const;
+
     virtual QString name() const = 0;
 
     virtual QString description() const;
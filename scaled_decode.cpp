@@ -0,0 +1,90 @@
+
+#include "scaled_decode.h"
+
+#include <QImageReader>
+#include <QImageIOHandler>
+
+QImage
+scaled_decode(const QString &filename, const QSize &requestedSize,
+        QSize *originalSize)
+{
+    QImageReader reader(filename);
+    QSize size = reader.size();
+
+    if (!size.isValid()) {
+        // The reader can't tell the size without decoding, do it the slow way
+        QImage image(filename);
+        size = image.size();
+        if (originalSize) {
+            *originalSize = size;
+        }
+
+        QSize targetSize(requestedSize);
+        if (image.isNull() || !targetSize.isValid() || targetSize.isNull()) {
+            return image;
+        }
+        if (targetSize.width() == 0) {
+            targetSize.setWidth(size.width()*targetSize.height()/size.height());
+        } else if (targetSize.height() == 0) {
+            targetSize.setHeight(size.height()*targetSize.width()/size.width());
+        }
+        return image.scaled(targetSize, Qt::KeepAspectRatio,
+                Qt::SmoothTransformation);
+    }
+
+    if (originalSize) {
+        *originalSize = size;
+    }
+
+    QSize targetSize(requestedSize);
+    if (!targetSize.isValid() || targetSize.isNull() || size.isEmpty()) {
+        return reader.read();
+    }
+    if (targetSize.width() == 0) {
+        targetSize.setWidth(size.width()*targetSize.height()/size.height());
+    } else if (targetSize.height() == 0) {
+        targetSize.setHeight(size.height()*targetSize.width()/size.width());
+    }
+
+    // The size the photo will end up at after KeepAspectRatio scaling
+    QSize fittedSize(size);
+    fittedSize.scale(targetSize, Qt::KeepAspectRatio);
+
+    // Largest of the JPEG DCT reductions (1/2, 1/4, 1/8) that still leaves
+    // at least fittedSize. Asking for exactly size / denominator (rounded
+    // up like libjpeg does) means the decoder has no resampling of its own
+    // to do
+    int denominator = 1;
+    while ((denominator < 8) &&
+            ((size.width() + 2*denominator - 1) / (2*denominator) >=
+                fittedSize.width()) &&
+            ((size.height() + 2*denominator - 1) / (2*denominator) >=
+                fittedSize.height())) {
+        denominator *= 2;
+    }
+
+    if ((denominator > 1) &&
+            reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        reader.setScaledSize(QSize(
+                (size.width() + denominator - 1) / denominator,
+                (size.height() + denominator - 1) / denominator));
+    }
+
+    QImage image = reader.read();
+    if (image.isNull() || (image.size() == fittedSize)) {
+        return image;
+    }
+    return image.scaled(fittedSize, Qt::IgnoreAspectRatio,
+            Qt::SmoothTransformation);
+}
+
+QSize
+image_size(const QString &filename)
+{
+    QSize size = QImageReader(filename).size();
+    if (!size.isValid()) {
+        // The reader can't tell the size without decoding
+        size = QImage(filename).size();
+    }
+    return size;
+}
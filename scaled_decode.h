@@ -0,0 +1,33 @@
+#ifndef SCALED_DECODE_H
+#define SCALED_DECODE_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+ * Load an image scaled to fit into requestedSize, keeping its aspect ratio.
+ *
+ * A zero width or height in requestedSize is derived from the other one and
+ * the aspect ratio of the image. An invalid or null requestedSize loads the
+ * image at full size.
+ *
+ * Decoders that can scale while decoding (JPEG can decode at 1/2, 1/4 and
+ * 1/8 size) are asked for the smallest such size that is still at least as
+ * large as the result, so only a small smooth resample is left to do. This
+ * avoids decoding, and holding in memory, the full resolution photo.
+ *
+ * If originalSize is not NULL it receives the full size of the image.
+ **/
+QImage
+scaled_decode(const QString &filename, const QSize &requestedSize,
+        QSize *originalSize=NULL);
+
+/**
+ * Get the size of an image, from its header if the format allows it, or
+ * else by decoding it. Returns an invalid size if it can not be read.
+ **/
+QSize
+image_size(const QString &filename);
+
+#endif